@@ -0,0 +1,128 @@
+#include "AllocationCounter.h"
+
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+// Per thread, so that workers analyzing other TUs don't show up in each
+// other's numbers.
+static thread_local uint64_t allocationCount = 0;
+
+uint64_t threadAllocationCount() {
+  return allocationCount;
+}
+
+static void *allocate(std::size_t size) {
+  allocationCount++;
+  return std::malloc(size ? size : 1);
+}
+
+static void *allocateOrFail(std::size_t size) {
+  if (void *pointer = allocate(size)) {
+    return pointer;
+  }
+  llvm::report_bad_alloc_error("Allocation failed");
+}
+
+void *operator new(std::size_t size) {
+  return allocateOrFail(size);
+}
+
+void *operator new[](std::size_t size) {
+  return allocateOrFail(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void *pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept {
+  std::free(pointer);
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void *pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+#endif
+
+#if defined(__cpp_aligned_new)
+static void *allocateAligned(std::size_t size, std::align_val_t alignment) {
+  allocationCount++;
+  void *pointer = nullptr;
+  std::size_t bytes = std::max(static_cast<std::size_t>(alignment), sizeof(void *));
+  if (posix_memalign(&pointer, bytes, size ? size : 1) != 0) {
+    return nullptr;
+  }
+  return pointer;
+}
+
+static void *allocateAlignedOrFail(std::size_t size, std::align_val_t alignment) {
+  if (void *pointer = allocateAligned(size, alignment)) {
+    return pointer;
+  }
+  llvm::report_bad_alloc_error("Allocation failed");
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  return allocateAlignedOrFail(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return allocateAlignedOrFail(size, alignment);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return allocateAligned(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+  return allocateAligned(size, alignment);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t, std::align_val_t) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t, const std::nothrow_t &) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t, const std::nothrow_t &) noexcept {
+  std::free(pointer);
+}
+#endif
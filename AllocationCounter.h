@@ -0,0 +1,19 @@
+#ifndef OBJC_UNUSED_IMPORTS_ALLOCATION_COUNTER_H
+#define OBJC_UNUSED_IMPORTS_ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+// Heap allocations the calling thread has made so far, for --alloc-stats and
+// the benchmarks. Counting replaces the global operator new and delete, so
+// AllocationCounter.cpp is only linked into the instrumented builds, which
+// define OBJC_UNUSED_IMPORTS_COUNT_ALLOCATIONS. Everywhere else the count
+// stays 0 and the allocator is the system's.
+#ifdef OBJC_UNUSED_IMPORTS_COUNT_ALLOCATIONS
+uint64_t threadAllocationCount();
+#else
+inline uint64_t threadAllocationCount() {
+  return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,198 @@
+#include "FileSystemCache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+
+using namespace clang;
+using namespace llvm;
+
+namespace {
+
+class CountingFile : public vfs::File {
+public:
+  CountingFile(std::unique_ptr<vfs::File> file, std::atomic<uint64_t> &bytesRead)
+    : file(std::move(file)), bytesRead(bytesRead) {}
+
+  ErrorOr<vfs::Status> status() override {
+    return file->status();
+  }
+
+  ErrorOr<std::string> getName() override {
+    return file->getName();
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> getBuffer(const Twine &name, int64_t fileSize, bool requiresNullTerminator,
+                                                   bool isVolatile) override {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = file->getBuffer(name, fileSize, requiresNullTerminator, isVolatile);
+    if (buffer) {
+      bytesRead += (*buffer)->getBufferSize();
+    }
+    return buffer;
+  }
+
+  std::error_code close() override {
+    return file->close();
+  }
+
+private:
+  std::unique_ptr<vfs::File> file;
+  std::atomic<uint64_t> &bytesRead;
+};
+
+// A file whose contents the cache holds. Every open hands out a buffer
+// pointing into them.
+class CachedFile : public vfs::File {
+public:
+  CachedFile(vfs::Status status, const MemoryBuffer &contents) : fileStatus(std::move(status)), contents(contents) {}
+
+  ErrorOr<vfs::Status> status() override {
+    return fileStatus;
+  }
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> getBuffer(const Twine &name, int64_t fileSize, bool requiresNullTerminator,
+                                                   bool isVolatile) override {
+    // Cached contents are always read with a null terminator.
+    return MemoryBuffer::getMemBuffer(contents.getBuffer(), name.str(), requiresNullTerminator);
+  }
+
+  std::error_code close() override {
+    return std::error_code();
+  }
+
+private:
+  vfs::Status fileStatus;
+  const MemoryBuffer &contents;
+};
+
+// Module builds write these while the run goes on.
+bool isWrittenDuringRun(StringRef path) {
+  StringRef extension = sys::path::extension(path);
+  return extension == ".pcm" || extension == ".pch" || extension == ".gch" || extension == ".lock" ||
+         extension == ".timestamp" || path.contains(".lock-");
+}
+
+bool isSourceOrHeader(StringRef path) {
+  StringRef extension = sys::path::extension(path);
+  return extension == ".h" || extension == ".hh" || extension == ".hpp" || extension == ".hxx" ||
+         extension == ".m" || extension == ".mm" || extension == ".c" || extension == ".cc" ||
+         extension == ".cpp" || extension == ".cxx" || extension == ".def" || extension == ".inc" ||
+         extension == ".modulemap" || path.endswith("/module.map");
+}
+
+} // end anonymous namespace
+
+ErrorOr<vfs::Status> CountingFileSystem::status(const Twine &path) {
+  stats++;
+  return base->status(path);
+}
+
+ErrorOr<std::unique_ptr<vfs::File>> CountingFileSystem::openFileForRead(const Twine &path) {
+  opens++;
+  ErrorOr<std::unique_ptr<vfs::File>> file = base->openFileForRead(path);
+  if (!file) {
+    return file.getError();
+  }
+  return std::unique_ptr<vfs::File>(new CountingFile(std::move(*file), bytesRead));
+}
+
+vfs::directory_iterator CountingFileSystem::dir_begin(const Twine &directory, std::error_code &errorCode) {
+  directoryReads++;
+  return base->dir_begin(directory, errorCode);
+}
+
+void CountingFileSystem::print(raw_ostream &out) const {
+  out << "File system: " << stats << " stats, " << opens << " opens, " << directoryReads << " directory reads, "
+      << format("%.1f MB read\n", bytesRead / 1048576.0);
+}
+
+SharedFileCache::Entry *SharedFileCache::entryFor(StringRef path) {
+  if (!sys::path::is_absolute(path) || isWrittenDuringRun(path)) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unique_ptr<Entry> &entry = entries[path];
+  if (!entry) {
+    entry.reset(new Entry());
+  }
+  return entry.get();
+}
+
+ErrorOr<vfs::Status> SharedFileCache::status(const Twine &path) {
+  SmallString<256> pathStorage;
+  StringRef pathString = path.toStringRef(pathStorage);
+  Entry *entry = entryFor(pathString);
+  if (!entry) {
+    return base->status(path);
+  }
+  std::lock_guard<std::mutex> lock(entry->mutex);
+  if (entry->hasStatus) {
+    statusHits++;
+    if (entry->statusError) {
+      return entry->statusError;
+    }
+    return entry->status;
+  }
+  ErrorOr<vfs::Status> status = base->status(pathString);
+  if (status) {
+    entry->status = *status;
+    entry->hasStatus = true;
+  } else if (isSourceOrHeader(pathString)) {
+    entry->statusError = status.getError();
+    entry->hasStatus = true;
+  }
+  return status;
+}
+
+ErrorOr<std::unique_ptr<vfs::File>> SharedFileCache::openFileForRead(const Twine &path) {
+  SmallString<256> pathStorage;
+  StringRef pathString = path.toStringRef(pathStorage);
+  Entry *entry = entryFor(pathString);
+  if (!entry) {
+    return base->openFileForRead(path);
+  }
+  std::lock_guard<std::mutex> lock(entry->mutex);
+  if (entry->hasContents) {
+    contentsHits++;
+  } else {
+    ErrorOr<std::unique_ptr<vfs::File>> file = base->openFileForRead(pathString);
+    if (!file) {
+      // Like a failed stat, only remember that sources and headers are missing.
+      if (!isSourceOrHeader(pathString)) {
+        return file.getError();
+      }
+      entry->contentsError = file.getError();
+    } else {
+      ErrorOr<vfs::Status> status = (*file)->status();
+      ErrorOr<std::unique_ptr<MemoryBuffer>> contents =
+        status ? (*file)->getBuffer(pathString, -1, /*RequiresNullTerminator=*/true, /*IsVolatile=*/false)
+               : ErrorOr<std::unique_ptr<MemoryBuffer>>(status.getError());
+      (*file)->close();
+      if (!contents) {
+        // Directories and the like are opened, but can't be read.
+        return contents.getError();
+      }
+      entry->status = *status;
+      entry->hasStatus = true;
+      entry->statusError = std::error_code();
+      entry->contents = std::move(*contents);
+      cachedBytes += entry->contents->getBufferSize();
+    }
+    entry->hasContents = true;
+  }
+  if (entry->contentsError) {
+    return entry->contentsError;
+  }
+  return std::unique_ptr<vfs::File>(
+    new CachedFile(vfs::Status::copyWithNewName(entry->status, pathString), *entry->contents));
+}
+
+void SharedFileCache::print(raw_ostream &out) {
+  size_t files;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    files = entries.size();
+  }
+  out << "File cache: " << files << " paths, " << statusHits << " stat hits, " << contentsHits << " read hits, "
+      << format("%.1f MB cached\n", cachedBytes / 1048576.0);
+}
@@ -0,0 +1,106 @@
+#ifndef OBJC_UNUSED_IMPORTS_FILE_SYSTEM_CACHE_H
+#define OBJC_UNUSED_IMPORTS_FILE_SYSTEM_CACHE_H
+
+#include "clang/Basic/VirtualFileSystem.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Counts what reaches the real file system, for --print-stats.
+class CountingFileSystem : public clang::vfs::FileSystem {
+public:
+  explicit CountingFileSystem(llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> base) : base(std::move(base)) {}
+
+  llvm::ErrorOr<clang::vfs::Status> status(const llvm::Twine &path) override;
+
+  llvm::ErrorOr<std::unique_ptr<clang::vfs::File>> openFileForRead(const llvm::Twine &path) override;
+
+  clang::vfs::directory_iterator dir_begin(const llvm::Twine &directory, std::error_code &errorCode) override;
+
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override {
+    return base->getCurrentWorkingDirectory();
+  }
+
+  std::error_code setCurrentWorkingDirectory(const llvm::Twine &path) override {
+    return base->setCurrentWorkingDirectory(path);
+  }
+
+  std::error_code getRealPath(const llvm::Twine &path, llvm::SmallVectorImpl<char> &output) const override {
+    return base->getRealPath(path, output);
+  }
+
+  void print(llvm::raw_ostream &out) const;
+
+  std::atomic<uint64_t> stats{0};
+  std::atomic<uint64_t> opens{0};
+  std::atomic<uint64_t> directoryReads{0};
+  std::atomic<uint64_t> bytesRead{0};
+
+private:
+  llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> base;
+};
+
+// The stats and contents of every file the TUs of a batch run read, shared by
+// all workers so each header is read from disk once per run, like the
+// dependency scanner's file system cache. Paths are expected to be absolute,
+// WorkingDirectoryFileSystem resolves them per worker above this layer.
+//
+// Module files and precompiled headers are written while the run goes on and
+// are never cached. A file that doesn't exist is only remembered for sources
+// and headers, which nothing creates during a run, so a header search path
+// probed by every TU is only stat'ed once.
+class SharedFileCache : public clang::vfs::FileSystem {
+public:
+  explicit SharedFileCache(llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> base) : base(std::move(base)) {}
+
+  llvm::ErrorOr<clang::vfs::Status> status(const llvm::Twine &path) override;
+
+  llvm::ErrorOr<std::unique_ptr<clang::vfs::File>> openFileForRead(const llvm::Twine &path) override;
+
+  clang::vfs::directory_iterator dir_begin(const llvm::Twine &directory, std::error_code &errorCode) override {
+    return base->dir_begin(directory, errorCode);
+  }
+
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override {
+    return base->getCurrentWorkingDirectory();
+  }
+
+  std::error_code setCurrentWorkingDirectory(const llvm::Twine &path) override {
+    return base->setCurrentWorkingDirectory(path);
+  }
+
+  std::error_code getRealPath(const llvm::Twine &path, llvm::SmallVectorImpl<char> &output) const override {
+    return base->getRealPath(path, output);
+  }
+
+  void print(llvm::raw_ostream &out);
+
+private:
+  struct Entry {
+    std::mutex mutex;
+    bool hasStatus = false;
+    std::error_code statusError;
+    clang::vfs::Status status;
+    bool hasContents = false;
+    std::error_code contentsError;
+    std::unique_ptr<llvm::MemoryBuffer> contents;
+  };
+
+  llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> base;
+  std::mutex mutex;
+  llvm::StringMap<std::unique_ptr<Entry>> entries;
+  std::atomic<uint64_t> statusHits{0};
+  std::atomic<uint64_t> contentsHits{0};
+  std::atomic<uint64_t> cachedBytes{0};
+
+  // Null for paths that bypass the cache.
+  Entry *entryFor(llvm::StringRef path);
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "HeaderCommands.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+
+using namespace clang::tooling;
+using namespace llvm;
+
+static std::string absolutePath(StringRef directory, StringRef file) {
+  SmallString<256> path(file);
+  if (!directory.empty() && !sys::path::is_absolute(path)) {
+    path = directory;
+    sys::path::append(path, file);
+  }
+  sys::fs::make_absolute(path);
+  sys::path::remove_dots(path, true);
+  return std::string(path.str());
+}
+
+bool isHeaderFile(StringRef file) {
+  StringRef extension = sys::path::extension(file);
+  return extension == ".h" || extension == ".hh" || extension == ".hpp";
+}
+
+HeaderCommandsDatabase::HeaderCommandsDatabase(const CompilationDatabase &inner) : inner(inner) {
+  for (const std::string &file : inner.getAllFiles()) {
+    std::string path = absolutePath(StringRef(), file);
+    filesByDirectory[sys::path::parent_path(path)].push_back(file);
+    files.push_back(file);
+  }
+}
+
+// The header's command is the source file's with the file name replaced and
+// the language forced, headers would otherwise be parsed as C.
+static CompileCommand transferCommand(const CompileCommand &command, StringRef source, StringRef header) {
+  StringRef language = sys::path::extension(source) == ".mm" ? "objective-c++" : "objective-c";
+  CompileCommand result;
+  result.Directory = command.Directory;
+  result.Filename = header.str();
+  // A header parsed as the main file would warn about its own #pragma once.
+  auto addHeader = [&]() {
+    result.CommandLine.push_back("-Wno-pragma-once-outside-header");
+    result.CommandLine.push_back("-x");
+    result.CommandLine.push_back(language.str());
+    result.CommandLine.push_back(header.str());
+  };
+  bool replaced = false;
+  for (const std::string &argument : command.CommandLine) {
+    if (!replaced && (argument == command.Filename || absolutePath(command.Directory, argument) == source)) {
+      addHeader();
+      replaced = true;
+    } else {
+      result.CommandLine.push_back(argument);
+    }
+  }
+  if (!replaced) {
+    addHeader();
+  }
+  return result;
+}
+
+std::vector<CompileCommand> HeaderCommandsDatabase::getCompileCommands(StringRef file) const {
+  std::vector<CompileCommand> commands = inner.getCompileCommands(file);
+  if (!commands.empty() || !isHeaderFile(file)) {
+    return commands;
+  }
+
+  std::string header = absolutePath(StringRef(), file);
+  std::vector<std::string> candidates;
+  auto directory = filesByDirectory.find(sys::path::parent_path(header));
+  if (directory != filesByDirectory.end()) {
+    StringRef stem = sys::path::stem(header);
+    for (const std::string &source : directory->second) {
+      if (sys::path::stem(source) == stem) {
+        candidates.push_back(source);
+      }
+    }
+    candidates.insert(candidates.end(), directory->second.begin(), directory->second.end());
+  }
+  if (!files.empty()) {
+    candidates.push_back(files.front());
+  }
+
+  for (const std::string &source : candidates) {
+    std::vector<CompileCommand> sourceCommands = inner.getCompileCommands(source);
+    if (!sourceCommands.empty()) {
+      return {transferCommand(sourceCommands.front(), absolutePath(StringRef(), source), header)};
+    }
+  }
+  return commands;
+}
+
+std::vector<std::string> headersOfSourceFiles(const std::vector<std::string> &files) {
+  std::vector<std::string> headers;
+  for (const std::string &file : files) {
+    if (isHeaderFile(file)) {
+      headers.push_back(file);
+      continue;
+    }
+    SmallString<256> header(file);
+    sys::path::replace_extension(header, ".h");
+    if (sys::fs::exists(header)) {
+      headers.push_back(std::string(header.str()));
+    }
+  }
+  std::sort(headers.begin(), headers.end());
+  headers.erase(std::unique(headers.begin(), headers.end()), headers.end());
+  return headers;
+}
@@ -0,0 +1,42 @@
+#ifndef OBJC_UNUSED_IMPORTS_HEADER_COMMANDS_H
+#define OBJC_UNUSED_IMPORTS_HEADER_COMMANDS_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <vector>
+
+// Compile commands for headers, which compilation databases don't list. A
+// header borrows the command of the source file with the same name next to
+// it, else of any source file in its directory, else the database's first
+// one, and is parsed as Objective-C.
+class HeaderCommandsDatabase : public clang::tooling::CompilationDatabase {
+public:
+  explicit HeaderCommandsDatabase(const clang::tooling::CompilationDatabase &inner);
+
+  std::vector<clang::tooling::CompileCommand> getCompileCommands(llvm::StringRef file) const override;
+
+  std::vector<std::string> getAllFiles() const override {
+    return inner.getAllFiles();
+  }
+
+  std::vector<clang::tooling::CompileCommand> getAllCompileCommands() const override {
+    return inner.getAllCompileCommands();
+  }
+
+private:
+  const clang::tooling::CompilationDatabase &inner;
+  std::vector<std::string> files;
+  // Source files of the database by directory.
+  llvm::StringMap<std::vector<std::string>> filesByDirectory;
+};
+
+bool isHeaderFile(llvm::StringRef file);
+
+// The headers next to the database's source files with the same name, for
+// --headers --all. Sorted, without duplicates.
+std::vector<std::string> headersOfSourceFiles(const std::vector<std::string> &files);
+
+#endif
@@ -0,0 +1,191 @@
+#include "ImportFixes.h"
+
+#include "clang/Tooling/ReplacementsYaml.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/YAMLTraits.h"
+
+#include <algorithm>
+
+using namespace clang::tooling;
+using namespace llvm;
+
+static bool isIdentifierChar(char c) {
+  return isAlnum(c) || c == '_' || c == '$';
+}
+
+// The whole line is removed, so it must hold the directive and nothing else:
+// no second directive, comment or code after it, and no continuation.
+static bool isImportLine(StringRef line) {
+  line = line.trim();
+  if (line.consume_front("@import")) {
+    size_t semicolon = line.find(';');
+    return semicolon != StringRef::npos && line.drop_front(semicolon + 1).trim().empty();
+  }
+  if (!line.consume_front("#")) {
+    return false;
+  }
+  line = line.ltrim();
+  if (!line.consume_front("import") && !line.consume_front("include_next") && !line.consume_front("include")) {
+    return false;
+  }
+  line = line.ltrim();
+  if (line.startswith("<") || line.startswith("\"")) {
+    size_t close = line.find(line.front() == '<' ? '>' : '"', 1);
+    return close != StringRef::npos && line.drop_front(close + 1).trim().empty();
+  }
+  // A macro naming the header.
+  return !line.empty() && std::all_of(line.begin(), line.end(), isIdentifierChar);
+}
+
+void ImportFixes::add(StringRef file, const std::vector<UnusedImport> &unusedImports) {
+  if (unusedImports.empty()) {
+    return;
+  }
+  SmallString<256> path(file);
+  sys::fs::make_absolute(path);
+  ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+  if (!buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    skipped += unusedImports.size();
+    return;
+  }
+  StringRef contents = (*buffer)->getBuffer();
+
+  // Offsets of the start of each line, 1-based like the reported lines.
+  std::vector<size_t> lineStarts = {0, 0};
+  for (size_t i = 0; i < contents.size(); i++) {
+    if (contents[i] == '\n') {
+      lineStarts.push_back(i + 1);
+    }
+  }
+  lineStarts.push_back(contents.size());
+
+  std::vector<Replacement> removals;
+  unsigned skippedLines = 0;
+  for (const UnusedImport &unusedImport : unusedImports) {
+    if (!unusedImport.forwardDeclarations.empty()) {
+      continue;
+    }
+    if (unusedImport.line == 0 || unusedImport.line + 1 >= lineStarts.size()) {
+      skippedLines++;
+      continue;
+    }
+    size_t begin = lineStarts[unusedImport.line];
+    size_t end = lineStarts[unusedImport.line + 1];
+    if (!isImportLine(contents.slice(begin, end))) {
+      skippedLines++;
+      continue;
+    }
+    removals.push_back(Replacement(path, begin, end - begin, ""));
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  skipped += skippedLines;
+  for (Replacement &removal : removals) {
+    if (!seen.insert(removal).second) {
+      continue;
+    }
+    if (Error error = replacements[removal.getFilePath()].add(removal)) {
+      consumeError(std::move(error));
+      conflicts++;
+    }
+  }
+}
+
+std::error_code ImportFixes::exportYAML(StringRef path) {
+  std::lock_guard<std::mutex> lock(mutex);
+  TranslationUnitReplacements document;
+  for (auto &file : replacements) {
+    document.Replacements.insert(document.Replacements.end(), file.second.begin(), file.second.end());
+  }
+
+  std::error_code error;
+  raw_fd_ostream out(path, error, sys::fs::F_None);
+  if (error) {
+    return error;
+  }
+  yaml::Output yaml(out);
+  yaml << document;
+  out.close();
+  error = out.error();
+  out.clear_error();
+  return error;
+}
+
+// Writes next to the file and renames over it, so an interrupted run never
+// leaves a source file half written.
+static std::error_code writeAtomically(StringRef path, StringRef contents) {
+  int fd;
+  SmallString<128> temporaryPath;
+  if (std::error_code error = sys::fs::createUniqueFile(path + ".tmp-%%%%%%", fd, temporaryPath)) {
+    return error;
+  }
+  {
+    raw_fd_ostream stream(fd, /*shouldClose=*/true);
+    stream << contents;
+    stream.close();
+    if (stream.has_error()) {
+      stream.clear_error();
+      sys::fs::remove(temporaryPath);
+      return std::make_error_code(std::errc::io_error);
+    }
+  }
+  if (std::error_code error = sys::fs::rename(temporaryPath, path)) {
+    sys::fs::remove(temporaryPath);
+    return error;
+  }
+  return std::error_code();
+}
+
+bool ImportFixes::apply(raw_ostream &errors) {
+  std::lock_guard<std::mutex> lock(mutex);
+  bool success = true;
+  for (auto &file : replacements) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(file.first);
+    if (!buffer) {
+      errors << "error: could not read " << file.first << ": " << buffer.getError().message() << "\n";
+      success = false;
+      continue;
+    }
+    Expected<std::string> fixed = applyAllReplacements((*buffer)->getBuffer(), file.second);
+    if (!fixed) {
+      errors << "error: could not fix " << file.first << ": " << toString(fixed.takeError()) << "\n";
+      success = false;
+      continue;
+    }
+    buffer->reset();
+    if (std::error_code error = writeAtomically(file.first, *fixed)) {
+      errors << "error: could not write " << file.first << ": " << error.message() << "\n";
+      success = false;
+    }
+  }
+  return success;
+}
+
+size_t ImportFixes::getFixCount() {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t count = 0;
+  for (auto &file : replacements) {
+    count += file.second.size();
+  }
+  return count;
+}
+
+size_t ImportFixes::getFileCount() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return replacements.size();
+}
+
+unsigned ImportFixes::getSkippedCount() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return skipped;
+}
+
+unsigned ImportFixes::getConflictCount() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return conflicts;
+}
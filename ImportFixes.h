@@ -0,0 +1,51 @@
+#ifndef OBJC_UNUSED_IMPORTS_IMPORT_FIXES_H
+#define OBJC_UNUSED_IMPORTS_IMPORT_FIXES_H
+
+#include "Matching.h"
+
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// Fixes for --fix and --export-fixes, which remove the line of every unused
+// import. Workers add the fixes of each TU as it finishes. Duplicates are
+// dropped and conflicts rejected as they arrive, and every file is written
+// once after the last TU.
+class ImportFixes {
+public:
+  // Lines holding anything besides a single #import, #include or @import,
+  // such as a second directive, a trailing comment or a continuation onto the
+  // next line, are left alone. Imports that forward declarations would
+  // replace need more than a removal and are skipped as well.
+  void add(llvm::StringRef file, const std::vector<UnusedImport> &unusedImports);
+
+  // Everything in one document, as clang-apply-replacements reads it.
+  std::error_code exportYAML(llvm::StringRef path);
+
+  // Rewrites every file with fixes. Returns false if any file couldn't be.
+  bool apply(llvm::raw_ostream &errors);
+
+  size_t getFixCount();
+
+  size_t getFileCount();
+
+  unsigned getSkippedCount();
+
+  unsigned getConflictCount();
+
+private:
+  std::mutex mutex;
+  std::map<std::string, clang::tooling::Replacements> replacements;
+  std::set<clang::tooling::Replacement> seen;
+  unsigned skipped = 0;
+  unsigned conflicts = 0;
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include "ImportIndex.h"
+#include "Serialization.h"
+
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+
+using namespace llvm;
+
+static const char Magic[4] = {'O', 'U', 'I', 'X'};
+static const uint32_t Version = 1;
+static const size_t HeaderSize = sizeof(Magic) + 4 * 4;
+// Offset and size of the name, first reference and reference count, and how
+// many of the references use the import.
+static const size_t ImportEntrySize = 8 + 4 + 4 + 4 + 4;
+// Offset and size of the path.
+static const size_t FileEntrySize = 8 + 4;
+// File, line and flags.
+static const size_t ReferenceEntrySize = 4 + 4 + 4;
+
+static const uint32_t UsedFlag = 1;
+static const uint32_t FailedFlag = 2;
+
+void ImportIndexWriter::add(StringRef file, int status, const TUSymbols &symbols,
+                            ArrayRef<UnusedImport> unusedImports) {
+  StringSet<> unusedNames;
+  for (const UnusedImport &unusedImport : unusedImports) {
+    unusedNames.insert(unusedImport.name);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  uint32_t fileID = static_cast<uint32_t>(files.size());
+  files.push_back(file.str());
+  for (auto &import : symbols.lineNumbers) {
+    StringRef name = symbols.names.name(import.first);
+    // Modules are reported by their top-level name, like their declarations.
+    if (symbols.modulesImported.count(import.first)) {
+      name = name.substr(0, name.find('.'));
+    }
+    uint32_t importID = importIDs.insert({name, static_cast<uint32_t>(importIDs.size())}).first->second;
+    uint32_t flags = unusedNames.count(name) ? 0 : UsedFlag;
+    if (status != 0) {
+      flags |= FailedFlag;
+    }
+    references.push_back({importID, fileID, import.second, flags});
+  }
+}
+
+std::error_code ImportIndexWriter::save() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // Imports are sorted by name for lookups, and each one's TUs by path.
+  std::vector<StringRef> importNames(importIDs.size());
+  for (auto &import : importIDs) {
+    importNames[import.second] = import.first();
+  }
+  std::vector<uint32_t> importOrder(importNames.size());
+  std::iota(importOrder.begin(), importOrder.end(), 0);
+  std::sort(importOrder.begin(), importOrder.end(), [&importNames](uint32_t lhs, uint32_t rhs) {
+    return importNames[lhs] < importNames[rhs];
+  });
+  std::vector<uint32_t> importRanks(importNames.size());
+  for (uint32_t rank = 0; rank < importOrder.size(); rank++) {
+    importRanks[importOrder[rank]] = rank;
+  }
+
+  std::vector<uint32_t> fileOrder(files.size());
+  std::iota(fileOrder.begin(), fileOrder.end(), 0);
+  std::sort(fileOrder.begin(), fileOrder.end(), [this](uint32_t lhs, uint32_t rhs) {
+    return files[lhs] < files[rhs];
+  });
+  std::vector<uint32_t> fileRanks(files.size());
+  for (uint32_t rank = 0; rank < fileOrder.size(); rank++) {
+    fileRanks[fileOrder[rank]] = rank;
+  }
+
+  std::vector<Reference> sorted;
+  sorted.reserve(references.size());
+  for (const Reference &reference : references) {
+    sorted.push_back({importRanks[reference.import], fileRanks[reference.file], reference.line, reference.flags});
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const Reference &lhs, const Reference &rhs) {
+    return std::tie(lhs.import, lhs.file, lhs.line) < std::tie(rhs.import, rhs.file, rhs.line);
+  });
+
+  std::string output;
+  BinaryWriter writer(output);
+  writer.writeBytes(StringRef(Magic, sizeof(Magic)));
+  writer.write32(Version);
+  writer.write32(static_cast<uint32_t>(importOrder.size()));
+  writer.write32(static_cast<uint32_t>(fileOrder.size()));
+  writer.write32(static_cast<uint32_t>(sorted.size()));
+
+  uint64_t stringOffset = HeaderSize + importOrder.size() * ImportEntrySize + fileOrder.size() * FileEntrySize +
+                          sorted.size() * ReferenceEntrySize;
+  size_t position = 0;
+  for (uint32_t importID : importOrder) {
+    uint32_t rank = importRanks[importID];
+    size_t first = position;
+    uint32_t used = 0;
+    for (; position < sorted.size() && sorted[position].import == rank; position++) {
+      used += (sorted[position].flags & UsedFlag) ? 1 : 0;
+    }
+    writer.write64(stringOffset);
+    writer.write32(static_cast<uint32_t>(importNames[importID].size()));
+    writer.write32(static_cast<uint32_t>(first));
+    writer.write32(static_cast<uint32_t>(position - first));
+    writer.write32(used);
+    stringOffset += importNames[importID].size();
+  }
+  for (uint32_t fileID : fileOrder) {
+    writer.write64(stringOffset);
+    writer.write32(static_cast<uint32_t>(files[fileID].size()));
+    stringOffset += files[fileID].size();
+  }
+  for (const Reference &reference : sorted) {
+    writer.write32(reference.file);
+    writer.write32(reference.line);
+    writer.write32(reference.flags);
+  }
+  for (uint32_t importID : importOrder) {
+    writer.writeBytes(importNames[importID]);
+  }
+  for (uint32_t fileID : fileOrder) {
+    writer.writeBytes(files[fileID]);
+  }
+
+  // Write next to the index and rename over it, so a query never sees a
+  // partial file.
+  int fd;
+  SmallString<128> temporaryPath;
+  if (std::error_code error = sys::fs::createUniqueFile(path + ".tmp-%%%%%%", fd, temporaryPath)) {
+    return error;
+  }
+  {
+    raw_fd_ostream stream(fd, /*shouldClose=*/true);
+    stream << output;
+    stream.close();
+    if (stream.has_error()) {
+      stream.clear_error();
+      sys::fs::remove(temporaryPath);
+      return std::make_error_code(std::errc::io_error);
+    }
+  }
+  if (std::error_code error = sys::fs::rename(temporaryPath, path)) {
+    sys::fs::remove(temporaryPath);
+    return error;
+  }
+  return std::error_code();
+}
+
+std::unique_ptr<ImportIndex> ImportIndex::open(StringRef path, std::string &error) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(path, -1, /*RequiresNullTerminator=*/false);
+  if (!file) {
+    error = file.getError().message();
+    return nullptr;
+  }
+  BinaryReader reader((*file)->getBuffer());
+  if (reader.readBytes(sizeof(Magic)) != StringRef(Magic, sizeof(Magic)) || reader.read32() != Version) {
+    error = "not an import index, or written by another version";
+    return nullptr;
+  }
+  std::unique_ptr<ImportIndex> index(new ImportIndex());
+  index->importCount = reader.read32();
+  index->fileCount = reader.read32();
+  index->referenceCount = reader.read32();
+  index->imports = reader.readBytes(size_t(index->importCount) * ImportEntrySize);
+  index->files = reader.readBytes(size_t(index->fileCount) * FileEntrySize);
+  index->references = reader.readBytes(size_t(index->referenceCount) * ReferenceEntrySize);
+  if (reader.failed()) {
+    error = "the index is truncated";
+    return nullptr;
+  }
+  index->buffer = std::move(*file);
+  return index;
+}
+
+StringRef ImportIndex::stringAt(StringRef entry) const {
+  BinaryReader reader(entry);
+  uint64_t offset = reader.read64();
+  uint32_t size = reader.read32();
+  StringRef data = buffer->getBuffer();
+  if (offset > data.size() || size > data.size() - offset) {
+    return StringRef();
+  }
+  return data.substr(offset, size);
+}
+
+StringRef ImportIndex::importAt(size_t position) const {
+  return stringAt(imports.substr(position * ImportEntrySize, ImportEntrySize));
+}
+
+std::vector<ImportReference> ImportIndex::referencesAt(size_t position) const {
+  BinaryReader reader(imports.substr(position * ImportEntrySize + 12, 8));
+  uint32_t first = reader.read32();
+  uint32_t count = reader.read32();
+  std::vector<ImportReference> result;
+  if (first > referenceCount || count > referenceCount - first) {
+    return result;
+  }
+  BinaryReader entries(references.substr(size_t(first) * ReferenceEntrySize, size_t(count) * ReferenceEntrySize));
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t file = entries.read32();
+    ImportReference reference;
+    reference.line = entries.read32();
+    uint32_t flags = entries.read32();
+    reference.used = flags & UsedFlag;
+    reference.failed = flags & FailedFlag;
+    if (file < fileCount) {
+      reference.file = stringAt(files.substr(size_t(file) * FileEntrySize, FileEntrySize));
+    }
+    result.push_back(reference);
+  }
+  return result;
+}
+
+void ImportIndex::countsAt(size_t position, unsigned &importers, unsigned &users) const {
+  BinaryReader reader(imports.substr(position * ImportEntrySize + 16, 8));
+  importers = reader.read32();
+  users = reader.read32();
+}
+
+std::vector<size_t> ImportIndex::find(StringRef name) const {
+  std::vector<size_t> result;
+  size_t low = 0;
+  size_t high = importCount;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (importAt(middle) < name) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low < importCount && importAt(low) == name) {
+    result.push_back(low);
+    return result;
+  }
+  std::string suffix = "/" + name.str();
+  for (size_t position = 0; position < importCount; position++) {
+    if (importAt(position).endswith(suffix)) {
+      result.push_back(position);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,93 @@
+#ifndef OBJC_UNUSED_IMPORTS_IMPORT_INDEX_H
+#define OBJC_UNUSED_IMPORTS_IMPORT_INDEX_H
+
+#include "Matching.h"
+#include "SymbolTable.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// One import of a TU as the index records it.
+struct ImportReference {
+  llvm::StringRef file;
+  unsigned int line = 0;
+  // Not reported as unused. A header that declares nothing is never reported,
+  // and counts as used.
+  bool used = false;
+  // The TU didn't compile, so the verdict may miss uses.
+  bool failed = false;
+};
+
+// Collects every import of every TU for --write-index, keyed by the header or
+// module imported. add() may be called from any thread.
+//
+// save() writes a sorted table of imports, each pointing at the run of TUs
+// that import it, followed by the TU paths and all names. Queries binary
+// search the mapped file and read nothing but the runs they ask for.
+class ImportIndexWriter {
+public:
+  explicit ImportIndexWriter(std::string path) : path(std::move(path)) {}
+
+  void add(llvm::StringRef file, int status, const TUSymbols &symbols, llvm::ArrayRef<UnusedImport> unusedImports);
+
+  std::error_code save();
+
+private:
+  struct Reference {
+    uint32_t import;
+    uint32_t file;
+    uint32_t line;
+    uint32_t flags;
+  };
+
+  std::string path;
+  std::mutex mutex;
+  std::vector<std::string> files;
+  llvm::StringMap<uint32_t> importIDs;
+  std::vector<Reference> references;
+};
+
+// A file written by ImportIndexWriter, mapped read-only.
+class ImportIndex {
+public:
+  // Returns null and sets `error` if the file can't be read or is corrupt.
+  static std::unique_ptr<ImportIndex> open(llvm::StringRef path, std::string &error);
+
+  size_t getImportCount() const {
+    return importCount;
+  }
+
+  llvm::StringRef importAt(size_t position) const;
+
+  // The TUs importing the import at `position`, in path order.
+  std::vector<ImportReference> referencesAt(size_t position) const;
+
+  // How many TUs import the import at `position`, and how many of them use it.
+  void countsAt(size_t position, unsigned &importers, unsigned &users) const;
+
+  // Imports named `name`, or if there is none, the headers whose path ends in
+  // `/name`, so `Foo.h` finds `Sources/Foo/Foo.h`.
+  std::vector<size_t> find(llvm::StringRef name) const;
+
+private:
+  std::unique_ptr<llvm::MemoryBuffer> buffer;
+  llvm::StringRef imports;
+  llvm::StringRef files;
+  llvm::StringRef references;
+  uint32_t importCount = 0;
+  uint32_t fileCount = 0;
+  uint32_t referenceCount = 0;
+
+  llvm::StringRef stringAt(llvm::StringRef entry) const;
+};
+
+#endif
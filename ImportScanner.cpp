@@ -0,0 +1,276 @@
+#include "ImportScanner.h"
+
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace llvm;
+
+namespace {
+
+#if defined(__SSE2__)
+#define OBJC_UNUSED_IMPORTS_SIMD 1
+typedef __m128i Vector;
+// Bits of a match mask per byte.
+const unsigned BitsPerByte = 1;
+
+inline Vector load(const char *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+inline Vector equal(Vector chunk, char byte) {
+  return _mm_cmpeq_epi8(chunk, _mm_set1_epi8(byte));
+}
+
+inline Vector either(Vector lhs, Vector rhs) {
+  return _mm_or_si128(lhs, rhs);
+}
+
+inline uint64_t maskOf(Vector matches) {
+  return static_cast<uint32_t>(_mm_movemask_epi8(matches));
+}
+#elif defined(__ARM_NEON)
+#define OBJC_UNUSED_IMPORTS_SIMD 1
+typedef uint8x16_t Vector;
+const unsigned BitsPerByte = 4;
+
+inline Vector load(const char *p) {
+  return vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+}
+
+inline Vector equal(Vector chunk, char byte) {
+  return vceqq_u8(chunk, vdupq_n_u8(static_cast<uint8_t>(byte)));
+}
+
+inline Vector either(Vector lhs, Vector rhs) {
+  return vorrq_u8(lhs, rhs);
+}
+
+// NEON has no movemask, narrowing leaves a nibble per byte instead.
+inline uint64_t maskOf(Vector matches) {
+  return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+}
+#endif
+
+const size_t ChunkSize = 16;
+
+// The first byte at or after `p` that is one of `needles`, or `end`.
+template <size_t N>
+const char *findFirstOf(const char *p, const char *end, const char (&needles)[N]) {
+#ifdef OBJC_UNUSED_IMPORTS_SIMD
+  while (static_cast<size_t>(end - p) >= ChunkSize) {
+    Vector chunk = load(p);
+    Vector matches = equal(chunk, needles[0]);
+    for (size_t i = 1; i < N; i++) {
+      matches = either(matches, equal(chunk, needles[i]));
+    }
+    if (uint64_t mask = maskOf(matches)) {
+      return p + countTrailingZeros(mask) / BitsPerByte;
+    }
+    p += ChunkSize;
+  }
+#endif
+  for (; p < end; p++) {
+    for (char needle : needles) {
+      if (*p == needle) {
+        return p;
+      }
+    }
+  }
+  return end;
+}
+
+unsigned countNewlines(const char *p, const char *end) {
+  unsigned count = 0;
+#ifdef OBJC_UNUSED_IMPORTS_SIMD
+  for (; static_cast<size_t>(end - p) >= ChunkSize; p += ChunkSize) {
+    count += countPopulation(maskOf(equal(load(p), '\n'))) / BitsPerByte;
+  }
+#endif
+  for (; p < end; p++) {
+    count += *p == '\n';
+  }
+  return count;
+}
+
+bool isHorizontalSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\f' || c == '\v' || c == '\r';
+}
+
+bool isIdentifierChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+class Scanner {
+public:
+  explicit Scanner(StringRef source) : begin(source.begin()), end(source.end()), lineStart(source.begin()) {}
+
+  std::vector<ScannedImport> scan() {
+    static const char CodeBytes[] = {'#', '@', '/', '"', '\''};
+    const char *p = begin;
+    while ((p = findFirstOf(p, end, CodeBytes)) != end) {
+      switch (*p) {
+      case '#':
+        p = isFirstOnLine(p) ? directive(p) : p + 1;
+        break;
+      case '@':
+        p = moduleImport(p);
+        break;
+      case '/':
+        p = comment(p);
+        break;
+      default:
+        p = literal(p);
+        break;
+      }
+    }
+    return std::move(imports);
+  }
+
+private:
+  const char *begin;
+  const char *end;
+  // Newlines are counted lazily, up to the last directive found.
+  const char *lineStart;
+  unsigned line = 1;
+  std::vector<ScannedImport> imports;
+
+  void add(StringRef name, const char *location, bool isModuleImport) {
+    line += countNewlines(lineStart, location);
+    lineStart = location;
+    imports.push_back(ScannedImport{name, line, isModuleImport});
+  }
+
+  // A directive's # may only follow whitespace on its line. A comment ending
+  // right before it might have started the line, so that counts as well.
+  bool isFirstOnLine(const char *p) const {
+    while (p > begin && isHorizontalSpace(p[-1])) {
+      p--;
+    }
+    return p == begin || p[-1] == '\n' || (p[-1] == '/' && p - 1 > begin && p[-2] == '*');
+  }
+
+  const char *skipSpace(const char *p) const {
+    while (p < end && isHorizontalSpace(*p)) {
+      p++;
+    }
+    return p;
+  }
+
+  const char *identifierEnd(const char *p) const {
+    while (p < end && isIdentifierChar(*p)) {
+      p++;
+    }
+    return p;
+  }
+
+  const char *lineEnd(const char *p) const {
+    static const char Newline[] = {'\n'};
+    return findFirstOf(p, end, Newline);
+  }
+
+  const char *directive(const char *hash) {
+    const char *nameBegin = skipSpace(hash + 1);
+    const char *nameEnd = identifierEnd(nameBegin);
+    StringRef name(nameBegin, nameEnd - nameBegin);
+    if (name != "import" && name != "include" && name != "include_next") {
+      return nameEnd;
+    }
+    const char *operandBegin = skipSpace(nameEnd);
+    const char *operandEnd = operandBegin;
+    if (operandBegin < end && (*operandBegin == '<' || *operandBegin == '"')) {
+      char close = *operandBegin == '<' ? '>' : '"';
+      operandBegin++;
+      operandEnd = operandBegin;
+      while (operandEnd < end && *operandEnd != close && *operandEnd != '\n') {
+        operandEnd++;
+      }
+    } else {
+      while (operandEnd < end && !isHorizontalSpace(*operandEnd) && *operandEnd != '\n') {
+        operandEnd++;
+      }
+    }
+    add(StringRef(operandBegin, operandEnd - operandBegin), hash, false);
+    return lineEnd(operandEnd);
+  }
+
+  const char *moduleImport(const char *at) {
+    const char *keywordEnd = identifierEnd(at + 1);
+    if (StringRef(at + 1, keywordEnd - at - 1) != "import") {
+      return keywordEnd;
+    }
+    const char *pathBegin = skipSpace(keywordEnd);
+    const char *pathEnd = pathBegin;
+    while (pathEnd < end && (isIdentifierChar(*pathEnd) || *pathEnd == '.')) {
+      pathEnd++;
+    }
+    if (pathEnd == pathBegin) {
+      return pathEnd;
+    }
+    add(StringRef(pathBegin, pathEnd - pathBegin), at, true);
+    return pathEnd;
+  }
+
+  const char *comment(const char *slash) {
+    if (slash + 1 >= end) {
+      return end;
+    }
+    if (slash[1] == '*') {
+      static const char Star[] = {'*'};
+      const char *p = slash + 2;
+      while ((p = findFirstOf(p, end, Star)) != end) {
+        if (p + 1 < end && p[1] == '/') {
+          return p + 2;
+        }
+        p++;
+      }
+      return end;
+    }
+    if (slash[1] == '/') {
+      // A backslash at the end of the line continues the comment.
+      const char *p = slash + 2;
+      while ((p = lineEnd(p)) != end) {
+        const char *last = p;
+        while (last > slash && (last[-1] == '\r')) {
+          last--;
+        }
+        if (last[-1] != '\\') {
+          return p + 1;
+        }
+        p++;
+      }
+      return end;
+    }
+    return slash + 1;
+  }
+
+  // Strings and character literals end at their quote or, unterminated, at
+  // the end of the line. The rest of a raw string spanning lines is scanned
+  // like code, which can only find directives that aren't there.
+  const char *literal(const char *quote) {
+    const char Stops[] = {*quote, '\\', '\n'};
+    const char *p = quote + 1;
+    while ((p = findFirstOf(p, end, Stops)) != end) {
+      if (*p == '\\') {
+        p = std::min(p + 2, end);
+        continue;
+      }
+      return p + 1;
+    }
+    return end;
+  }
+};
+
+} // end anonymous namespace
+
+std::vector<ScannedImport> scanImports(StringRef source) {
+  return Scanner(source).scan();
+}
@@ -0,0 +1,27 @@
+#ifndef OBJC_UNUSED_IMPORTS_IMPORT_SCANNER_H
+#define OBJC_UNUSED_IMPORTS_IMPORT_SCANNER_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <vector>
+
+// An import directive found in the raw text of a file.
+struct ScannedImport {
+  // The header as spelled between <> or "", the module path of an @import, or
+  // whatever token a macro-expanded #import names.
+  llvm::StringRef name;
+  unsigned line;
+  bool isModuleImport;
+};
+
+// Finds the #import, #include and @import directives of a file without
+// preprocessing it, for --prefilter. Comments, strings and character literals
+// are skipped, but conditionals aren't evaluated, so a directive inside #if 0
+// is still found. The result is a superset of what the compiler imports: a
+// file it finds nothing in imports nothing.
+//
+// Stretches of plain code are skipped 16 bytes at a time with SSE2 or NEON
+// where the target has them.
+std::vector<ScannedImport> scanImports(llvm::StringRef source);
+
+#endif
@@ -0,0 +1,265 @@
+#include "Matching.h"
+
+#include <algorithm>
+#include <tuple>
+
+// Variables, functions, enum constants, typedefs and tags are matched by
+// declaration rather than by name, see TUSymbols::usedImports, so the main
+// file records no usages of them and their declarations have no rule.
+const UsageRule usageRules[SymbolTypeCount] = {
+  /* ClassDeclaration */ {{SymbolType::Class}, 1, false},
+  /* Class */ {{}, 0, false},
+  /* TypedefDeclaration */ {{}, 0, false},
+  /* Type */ {{}, 0, false},
+  /* StructDeclaration */ {{}, 0, false},
+  /* Struct */ {{}, 0, false},
+  /* VariableDeclaration */ {{}, 0, false},
+  /* Variable */ {{}, 0, false},
+  /* FunctionDeclaration */ {{}, 0, false},
+  /* Function */ {{}, 0, false},
+  /* EnumDeclaration */ {{}, 0, false},
+  /* Enum */ {{}, 0, false},
+  /* ProtocolDeclaration */ {{SymbolType::Protocol}, 1, false},
+  /* Protocol */ {{}, 0, false},
+  /* MethodDeclaration */ {{SymbolType::Method}, 1, true},
+  /* Method */ {{}, 0, false},
+  /* EnumConstantDeclaration */ {{}, 0, false},
+  /* EnumConstant */ {{}, 0, false},
+  /* PropertyDeclaration */ {{SymbolType::Property, SymbolType::Method}, 2, true},
+  /* Property */ {{}, 0, false},
+  /* MacroDefinition */ {{SymbolType::Macro}, 1, false},
+  /* Macro */ {{}, 0, false},
+  /* ProtocolConformanceDeclaration */ {{SymbolType::ProtocolConformance}, 1, true},
+  /* ProtocolConformance */ {{}, 0, false},
+  /* CategoryDeclaration */ {{SymbolType::Category}, 1, false},
+  /* Category */ {{}, 0, false},
+};
+
+UsageIndex::UsageIndex(const SymbolSet &mainSymbols, NameID idName) : idName(idName) {
+  for (auto &entry : mainSymbols) {
+    tables[static_cast<size_t>(entry.first.type)].insert(std::make_pair(entry.first.name, &entry.second));
+  }
+}
+
+const uint32_t ClassHierarchy::NoClass;
+
+ClassHierarchy::ClassHierarchy(const SuperClassMap &superClass, size_t nameCount) : classIDs(nameCount, NoClass) {
+  auto classID = [this](NameID name) {
+    if (classIDs[name] == NoClass) {
+      classIDs[name] = static_cast<uint32_t>(intervals.size());
+      intervals.push_back({NoClass, NoClass});
+    }
+    return classIDs[name];
+  };
+
+  std::vector<std::pair<uint32_t, uint32_t>> links;
+  links.reserve(superClass.size());
+  for (auto &entry : superClass) {
+    links.push_back(std::make_pair(classID(entry.second), classID(entry.first)));
+  }
+
+  // Children of every class, as one array sliced by childrenBegin.
+  size_t classCount = intervals.size();
+  std::vector<uint32_t> childrenBegin(classCount + 1, 0);
+  std::vector<bool> hasParent(classCount, false);
+  for (auto &link : links) {
+    childrenBegin[link.first + 1]++;
+    hasParent[link.second] = true;
+  }
+  for (size_t i = 0; i < classCount; i++) {
+    childrenBegin[i + 1] += childrenBegin[i];
+  }
+  std::vector<uint32_t> children(links.size());
+  std::vector<uint32_t> fill(childrenBegin.begin(), childrenBegin.end() - 1);
+  for (auto &link : links) {
+    children[fill[link.first]++] = link.second;
+  }
+
+  uint32_t preorder = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> stack;
+  auto visit = [&](uint32_t root) {
+    intervals[root].first = preorder++;
+    stack.push_back(std::make_pair(root, childrenBegin[root]));
+    while (!stack.empty()) {
+      uint32_t node = stack.back().first;
+      uint32_t &next = stack.back().second;
+      if (next == childrenBegin[node + 1]) {
+        intervals[node].last = preorder - 1;
+        stack.pop_back();
+        continue;
+      }
+      uint32_t child = children[next++];
+      // Only reachable twice through a superclass cycle, which isn't valid
+      // Objective-C but shouldn't hang the tool either.
+      if (intervals[child].first != NoClass) {
+        continue;
+      }
+      intervals[child].first = preorder++;
+      stack.push_back(std::make_pair(child, childrenBegin[child]));
+    }
+  };
+  for (uint32_t root = 0; root < classCount; root++) {
+    if (!hasParent[root]) {
+      visit(root);
+    }
+  }
+  // Classes on a cycle have no root above them.
+  for (uint32_t node = 0; node < classCount; node++) {
+    if (intervals[node].first == NoClass) {
+      visit(node);
+    }
+  }
+}
+
+bool matchWithClass(const ClassNameList &classNames, const ClassNameList *mainFileClassNames, const UsageIndex &usages, const ClassHierarchy &hierarchy) {
+  if (!mainFileClassNames) {
+    return false;
+  }
+
+  for (NameID className : classNames) {
+    for (NameID mainFileClassName : *mainFileClassNames) {
+      // Be conservative with methods called on id
+      if (mainFileClassName == usages.getIdName()) {
+        return true;
+      }
+      if (hierarchy.isSameOrSubClass(className, mainFileClassName)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool symbolUsed(const Symbol &symbol, const ClassNameList &classNames, const UsageIndex &usages, const ClassHierarchy &hierarchy) {
+  const UsageRule &rule = usageRules[static_cast<size_t>(symbol.type)];
+  for (unsigned i = 0; i < rule.usageCount; i++) {
+    const ClassNameList *mainFileClassNames = usages.find(rule.usages[i], symbol.name);
+    if (rule.matchClass) {
+      if (matchWithClass(classNames, mainFileClassNames, usages, hierarchy)) {
+        return true;
+      }
+    } else if (mainFileClassNames) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool anySymbolUsed(const SymbolSet &symbols, const UsageIndex &usages, const ClassHierarchy &hierarchy) {
+  for (auto &entry : symbols) {
+    if (symbolUsed(entry.first, entry.second, usages, hierarchy)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool anyModuleExportUsed(const ModuleExports &exports, const TUSymbols &tuSymbols, const SymbolSet &mainSymbols,
+                         const UsageIndex &usages, const ClassHierarchy &hierarchy) {
+  // Looks the main file's usages up in the module rather than the other way
+  // around, the main file uses far fewer names than a module declares. A name
+  // the module never interned can't match any of its symbols. Receiver classes
+  // stay in the TU's names, which the hierarchy uses.
+  for (auto &usage : mainSymbols) {
+    SymbolType usageType = usage.first.type;
+    NameID name = InvalidName;
+    for (size_t type = 0; type < SymbolTypeCount; type++) {
+      const UsageRule &rule = usageRules[type];
+      if (std::find(rule.usages, rule.usages + rule.usageCount, usageType) == rule.usages + rule.usageCount) {
+        continue;
+      }
+      if (name == InvalidName) {
+        name = exports.names.find(tuSymbols.names.name(usage.first.name));
+        if (name == InvalidName) {
+          break;
+        }
+      }
+      auto declaration = exports.symbols.find(Symbol{static_cast<SymbolType>(type), name});
+      if (declaration == exports.symbols.end()) {
+        continue;
+      }
+      if (!rule.matchClass) {
+        return true;
+      }
+      // A class the TU never interned, usually the protocol of a protocol
+      // method, isn't in its hierarchy. It is kept as InvalidName, which no
+      // receiver is a subclass of, so an id receiver still matches it like it
+      // would have in the TU's own names.
+      ClassNameList classNames;
+      for (NameID className : declaration->second) {
+        classNames.push_back(tuSymbols.names.find(exports.names.name(className)));
+      }
+      if (matchWithClass(classNames, &usage.second, usages, hierarchy)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+std::vector<UnusedImport> findUnusedImports(const TUSymbols &tuSymbols) {
+  std::vector<UnusedImport> unusedImports;
+  static const SymbolSet noSymbols;
+  auto mainSymbolsIter = tuSymbols.symbolsForFile.find(tuSymbols.mainFile);
+  const SymbolSet &mainSymbols = mainSymbolsIter != tuSymbols.symbolsForFile.end() ? mainSymbolsIter->second : noSymbols;
+  UsageIndex usages(mainSymbols, tuSymbols.names.find("id"));
+  ClassHierarchy hierarchy(tuSymbols.superClass, tuSymbols.names.size());
+
+  for (auto &pair : tuSymbols.symbolsForFile) {
+    llvm::StringRef fileName = tuSymbols.names.name(pair.first);
+    if (!fileName.endswith(".h") && tuSymbols.modulesImported.find(pair.first) == tuSymbols.modulesImported.end()) {
+      continue;
+    }
+
+    if (tuSymbols.usedImports.count(pair.first) == 0 && !anySymbolUsed(pair.second, usages, hierarchy)) {
+      auto lineIter = tuSymbols.lineNumbers.find(pair.first);
+      unsigned int line = lineIter != tuSymbols.lineNumbers.end() ? lineIter->second : 0;
+      unusedImports.push_back({fileName.str(), line, static_cast<unsigned int>(pair.second.size())});
+    }
+  }
+
+  for (auto &module : tuSymbols.indexedModules) {
+    // Like headers, a module that declares nothing is never reported.
+    if (module.second->symbols.empty() || tuSymbols.modulesImported.find(module.first) == tuSymbols.modulesImported.end()) {
+      continue;
+    }
+    if (tuSymbols.usedImports.count(module.first) == 0 &&
+        !anyModuleExportUsed(*module.second, tuSymbols, mainSymbols, usages, hierarchy)) {
+      auto lineIter = tuSymbols.lineNumbers.find(module.first);
+      unsigned int line = lineIter != tuSymbols.lineNumbers.end() ? lineIter->second : 0;
+      unusedImports.push_back({tuSymbols.names.name(module.first).str(), line,
+                               static_cast<unsigned int>(module.second->symbols.size())});
+    }
+  }
+
+  // symbolsForFile is unordered, sort so that every run reports in the same order.
+  std::sort(unusedImports.begin(), unusedImports.end(), [](const UnusedImport &lhs, const UnusedImport &rhs) {
+    return std::tie(lhs.line, lhs.name) < std::tie(rhs.line, rhs.name);
+  });
+  return unusedImports;
+}
+
+std::vector<UnusedImport> findReplaceableHeaderImports(const TUSymbols &tuSymbols, const HeaderImportUses &uses) {
+  std::vector<UnusedImport> replaceableImports;
+  for (auto &import : tuSymbols.lineNumbers) {
+    llvm::StringRef name = tuSymbols.names.name(import.first);
+    NameID useName = import.first;
+    // Declarations are attributed to their top-level module.
+    if (tuSymbols.modulesImported.find(import.first) != tuSymbols.modulesImported.end()) {
+      useName = tuSymbols.names.find(name.substr(0, name.find('.')));
+    }
+    auto useIter = useName != InvalidName ? uses.find(useName) : uses.end();
+    if (useIter == uses.end()) {
+      replaceableImports.push_back({name.str(), import.second});
+    } else if (!useIter->second.needsDefinition) {
+      replaceableImports.push_back({name.str(), import.second});
+      replaceableImports.back().forwardDeclarations.assign(useIter->second.forwardDeclarations.begin(),
+                                                           useIter->second.forwardDeclarations.end());
+    }
+  }
+
+  std::sort(replaceableImports.begin(), replaceableImports.end(), [](const UnusedImport &lhs, const UnusedImport &rhs) {
+    return std::tie(lhs.line, lhs.name) < std::tie(rhs.line, rhs.name);
+  });
+  return replaceableImports;
+}
@@ -0,0 +1,154 @@
+#ifndef OBJC_UNUSED_IMPORTS_MATCHING_H
+#define OBJC_UNUSED_IMPORTS_MATCHING_H
+
+#include "SymbolTable.h"
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+// What an import adds to its TU's build, for --import-cost. Everything the
+// preprocessor entered while the import was open counts, nested headers
+// included. A header an earlier import already brought in costs nothing.
+struct ImportCost {
+  uint64_t bytes = 0;
+  uint64_t tokens = 0;
+  // Files the TU hadn't read before.
+  unsigned int files = 0;
+  // Lexing, parsing and semantic analysis until the import is closed.
+  double seconds = 0;
+};
+
+struct UnusedImport {
+  std::string name;
+  unsigned int line;
+  // Declarations of the import, none of which the main file uses.
+  unsigned int symbols = 0;
+  ImportCost cost;
+  // For --headers, the forward declarations that can replace an import the
+  // header only uses through pointers. Empty if the import isn't used at all.
+  std::vector<std::string> forwardDeclarations;
+};
+
+// How a header uses what one of its imports declares, for --headers.
+struct HeaderImportUse {
+  // Subclassing, protocol adoption, a category, a struct or enum by value, a
+  // typedef, a macro, or anything inline code calls or messages.
+  bool needsDefinition = false;
+  // "@class Foo;", "@protocol Bar;" or "struct Baz;" for each use through a
+  // pointer.
+  std::set<std::string> forwardDeclarations;
+};
+
+// Keyed by the header's name, or by the top-level module's name.
+typedef llvm::DenseMap<NameID, HeaderImportUse> HeaderImportUses;
+
+// The superclass forest with classes numbered in DFS preorder, built once the
+// traversal has recorded every superclass link. Each class keeps the range of
+// preorder numbers of its subtree, so a subclass check is two comparisons.
+class ClassHierarchy {
+public:
+  ClassHierarchy(const SuperClassMap &superClass, size_t nameCount);
+
+  bool isSameOrSubClass(NameID referenceClass, NameID testClass) const {
+    if (referenceClass == testClass) {
+      return true;
+    }
+    if (referenceClass >= classIDs.size() || testClass >= classIDs.size()) {
+      return false;
+    }
+    uint32_t reference = classIDs[referenceClass];
+    uint32_t test = classIDs[testClass];
+    if (reference == NoClass || test == NoClass) {
+      return false;
+    }
+    return intervals[reference].first <= intervals[test].first && intervals[test].first <= intervals[reference].last;
+  }
+
+  size_t size() const {
+    return intervals.size();
+  }
+
+  size_t getMemorySize() const {
+    return classIDs.capacity() * sizeof(uint32_t) + intervals.capacity() * sizeof(Interval);
+  }
+
+private:
+  static const uint32_t NoClass = UINT32_MAX;
+
+  struct Interval {
+    // Preorder number of the class.
+    uint32_t first;
+    // Largest preorder number in the class's subtree.
+    uint32_t last;
+  };
+
+  // Indexed by NameID.
+  std::vector<uint32_t> classIDs;
+  // Indexed by class ID.
+  std::vector<Interval> intervals;
+};
+
+// Which usage kinds satisfy a declaration kind. Indexed by the declaration's
+// SymbolType, usage kinds have no rule.
+struct UsageRule {
+  SymbolType usages[2];
+  uint8_t usageCount;
+  // Usages must come from a receiver that is the declaring class or a subclass of it.
+  bool matchClass;
+};
+
+extern const UsageRule usageRules[SymbolTypeCount];
+
+// Read-only view of the symbols used by the main file, with one table per
+// usage kind. It points into the main file's SymbolSet, which must outlive it
+// and stay unchanged.
+class UsageIndex {
+public:
+  UsageIndex(const SymbolSet &mainSymbols, NameID idName);
+
+  // Receiver classes the main file used (type, name) with, or null if it never
+  // used it.
+  const ClassNameList *find(SymbolType type, NameID name) const {
+    const auto &table = tables[static_cast<size_t>(type)];
+    auto iter = table.find(name);
+    return iter == table.end() ? nullptr : iter->second;
+  }
+
+  bool contains(SymbolType type, NameID name) const {
+    return find(type, name) != nullptr;
+  }
+
+  // The name "id", a receiver that could be any class. InvalidName if the TU
+  // never interned it.
+  NameID getIdName() const {
+    return idName;
+  }
+
+private:
+  llvm::DenseMap<NameID, const ClassNameList *> tables[SymbolTypeCount];
+  NameID idName;
+};
+
+bool matchWithClass(const ClassNameList &classNames, const ClassNameList *mainFileClassNames, const UsageIndex &usages, const ClassHierarchy &hierarchy);
+
+bool symbolUsed(const Symbol &symbol, const ClassNameList &classNames, const UsageIndex &usages, const ClassHierarchy &hierarchy);
+
+bool anySymbolUsed(const SymbolSet &symbols, const UsageIndex &usages, const ClassHierarchy &hierarchy);
+
+// Whether the main file uses any symbol of a module from the export index.
+// `usages` indexes mainSymbols, it is built once per TU for all its modules.
+bool anyModuleExportUsed(const ModuleExports &exports, const TUSymbols &tuSymbols, const SymbolSet &mainSymbols,
+                         const UsageIndex &usages, const ClassHierarchy &hierarchy);
+
+// Imported headers and modules none of whose symbols the main file uses,
+// sorted by line.
+std::vector<UnusedImport> findUnusedImports(const TUSymbols &symbols);
+
+// Imports of a header subject that it doesn't use, or only uses in ways
+// forward declarations satisfy, sorted by line.
+std::vector<UnusedImport> findReplaceableHeaderImports(const TUSymbols &symbols, const HeaderImportUses &uses);
+
+#endif
@@ -0,0 +1,36 @@
+#include "ModuleIndex.h"
+
+static ClassNameList renameClasses(const ClassNameList &classNames, const NameTable &from, NameTable &to) {
+  ClassNameList renamed;
+  for (NameID className : classNames) {
+    renamed.push_back(to.intern(from.name(className)));
+  }
+  return renamed;
+}
+
+std::shared_ptr<ModuleExports> makeModuleExports(const NameTable &names, const SymbolSet &symbols) {
+  std::shared_ptr<ModuleExports> exports = std::make_shared<ModuleExports>();
+  exports->symbols.reserve(symbols.size());
+  for (auto &entry : symbols) {
+    Symbol symbol = {entry.first.type, exports->names.intern(names.name(entry.first.name))};
+    exports->symbols[symbol] = renameClasses(entry.second, names, exports->names);
+  }
+  return exports;
+}
+
+void materializeIndexedModules(TUSymbols &tuSymbols) {
+  for (auto &module : tuSymbols.indexedModules) {
+    const ModuleExports &exports = *module.second;
+    SymbolSet &symbols = tuSymbols.symbolsForFile[module.first];
+    for (auto &entry : exports.symbols) {
+      Symbol symbol = {entry.first.type, tuSymbols.names.intern(exports.names.name(entry.first.name))};
+      if (entry.second.empty()) {
+        insertSymbol(symbols, symbol);
+      }
+      for (NameID className : entry.second) {
+        insertSymbol(symbols, symbol, tuSymbols.names.intern(exports.names.name(className)));
+      }
+    }
+  }
+  tuSymbols.indexedModules.clear();
+}
@@ -0,0 +1,50 @@
+#ifndef OBJC_UNUSED_IMPORTS_MODULE_INDEX_H
+#define OBJC_UNUSED_IMPORTS_MODULE_INDEX_H
+
+#include "SymbolTable.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <memory>
+#include <mutex>
+
+// The exports of every module seen so far, shared by all TUs of the process.
+// A module's declarations and macros only depend on the module file they are
+// loaded from, so the first TU that imports a module collects them and every
+// later TU reuses the table. Keys name the module, the configuration it was
+// built with and the module file, see ModuleExportCollector.
+class ModuleExportIndex {
+public:
+  std::shared_ptr<const ModuleExports> find(llvm::StringRef key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = entries.find(key);
+    return iter == entries.end() ? nullptr : iter->second;
+  }
+
+  // Two TUs can collect the same module at once. The first one to publish it
+  // wins, and both get that entry back.
+  std::shared_ptr<const ModuleExports> insert(llvm::StringRef key, std::shared_ptr<const ModuleExports> exports) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto inserted = entries.insert(std::make_pair(key, std::move(exports)));
+    return inserted.first->second;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+  }
+
+private:
+  mutable std::mutex mutex;
+  llvm::StringMap<std::shared_ptr<const ModuleExports>> entries;
+};
+
+// Copies a module's symbols out of a TU, renamed into their own table.
+std::shared_ptr<ModuleExports> makeModuleExports(const NameTable &names, const SymbolSet &symbols);
+
+// Copies the symbols of indexed modules into symbolsForFile, for the consumers
+// that want every symbol in the TU's own names (debug output, dumps).
+void materializeIndexedModules(TUSymbols &tuSymbols);
+
+#endif
@@ -0,0 +1,92 @@
+#include "PreambleCache.h"
+
+#include "clang/Frontend/CompilerInstance.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+
+using namespace clang;
+
+std::shared_ptr<PrecompiledPreamble> PreambleCache::get(llvm::StringRef flags,
+                                                        const CompilerInvocation &invocation,
+                                                        const llvm::MemoryBuffer &mainBuffer,
+                                                        const PreambleBounds &bounds,
+                                                        IntrusiveRefCntPtr<vfs::FileSystem> fileSystem,
+                                                        std::shared_ptr<PCHContainerOperations> pchContainerOps) {
+  llvm::MD5 hash;
+  hash.update(flags);
+  hash.update(llvm::StringRef(mainBuffer.getBufferStart(), bounds.Size));
+  hash.update(bounds.PreambleEndsAtStartOfLine ? "1" : "0");
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> key;
+  llvm::MD5::stringifyResult(result, key);
+
+  Entry *entry;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<Entry> &slot = entries[key];
+    if (!slot) {
+      slot.reset(new Entry());
+    }
+    entry = slot.get();
+  }
+
+  std::lock_guard<std::mutex> lock(entry->mutex);
+  entry->requests++;
+  if (entry->attempted) {
+    if (entry->preamble) {
+      reused++;
+    }
+    return entry->preamble;
+  }
+  if (entry->requests < 2) {
+    return nullptr;
+  }
+
+  // Build at most once per key, a preamble that fails to build would fail the
+  // same way for every other TU.
+  entry->attempted = true;
+  IntrusiveRefCntPtr<DiagnosticsEngine> diagnostics =
+    CompilerInstance::createDiagnostics(new DiagnosticOptions(), new IgnoringDiagConsumer(), /*ShouldOwnClient=*/true);
+  PreambleCallbacks callbacks;
+  llvm::ErrorOr<PrecompiledPreamble> preamble =
+    PrecompiledPreamble::Build(invocation, &mainBuffer, bounds, *diagnostics, fileSystem, std::move(pchContainerOps),
+                               /*StoreInMemory=*/false, callbacks);
+  if (!preamble) {
+    return nullptr;
+  }
+  entry->preamble = std::make_shared<PrecompiledPreamble>(std::move(*preamble));
+  built++;
+  return entry->preamble;
+}
+
+std::string flagsKey(const tooling::CompileCommand &command) {
+  std::string key = command.Directory;
+  // Quoted imports are looked up next to the main file first, so the same
+  // preamble bytes can name different headers in another directory.
+  llvm::SmallString<256> mainFile(command.Filename);
+  llvm::sys::fs::make_absolute(command.Directory, mainFile);
+  llvm::sys::path::remove_dots(mainFile, true);
+  key += '\0';
+  key += llvm::sys::path::parent_path(mainFile);
+  bool skipNext = false;
+  for (const std::string &argument : command.CommandLine) {
+    if (skipNext) {
+      skipNext = false;
+      continue;
+    }
+    // Output, dependency and diagnostic files are named after the input.
+    if (argument == "-o" || argument == "-MF" || argument == "-MT" || argument == "-MQ" ||
+        argument == "--serialize-diagnostics") {
+      skipNext = true;
+      continue;
+    }
+    if (argument == command.Filename) {
+      continue;
+    }
+    key += '\0';
+    key += argument;
+  }
+  return key;
+}
@@ -0,0 +1,61 @@
+#ifndef OBJC_UNUSED_IMPORTS_PREAMBLE_CACHE_H
+#define OBJC_UNUSED_IMPORTS_PREAMBLE_CACHE_H
+
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/PCHContainerOperations.h"
+#include "clang/Frontend/PrecompiledPreamble.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringMap.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Precompiled preambles shared by the TUs of a batch run. Most files start with
+// the same imports, so TUs compiled with the same flags whose preambles have
+// the same bytes parse those headers once and load the result afterwards.
+//
+// A preamble is only built the second time its key is seen, a prefix that no
+// other TU shares isn't worth writing to disk. TUs asking for a preamble that
+// is being built wait for it instead of parsing the headers themselves.
+class PreambleCache {
+public:
+  // Returns a preamble the invocation can use for mainBuffer, or null if it
+  // should be parsed from scratch. `flags` identifies the compile command, see
+  // flagsKey.
+  std::shared_ptr<clang::PrecompiledPreamble> get(llvm::StringRef flags,
+                                                  const clang::CompilerInvocation &invocation,
+                                                  const llvm::MemoryBuffer &mainBuffer,
+                                                  const clang::PreambleBounds &bounds,
+                                                  llvm::IntrusiveRefCntPtr<clang::vfs::FileSystem> fileSystem,
+                                                  std::shared_ptr<clang::PCHContainerOperations> pchContainerOps);
+
+  unsigned getBuiltCount() const {
+    return built;
+  }
+
+  unsigned getReusedCount() const {
+    return reused;
+  }
+
+private:
+  struct Entry {
+    std::mutex mutex;
+    unsigned requests = 0;
+    bool attempted = false;
+    std::shared_ptr<clang::PrecompiledPreamble> preamble;
+  };
+
+  std::mutex mutex;
+  llvm::StringMap<std::unique_ptr<Entry>> entries;
+  std::atomic<unsigned> built{0};
+  std::atomic<unsigned> reused{0};
+};
+
+// The arguments of a compile command without its input and output files, so
+// commands that only differ in the file they compile get the same key, as long
+// as the files are in the same directory.
+std::string flagsKey(const clang::tooling::CompileCommand &command);
+
+#endif
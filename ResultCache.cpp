@@ -0,0 +1,319 @@
+#include "ResultCache.h"
+#include "Serialization.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LockFileManager.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static const char Magic[4] = {'O', 'U', 'I', 'C'};
+// Bump whenever the format or what the tool reports changes, older caches are
+// then ignored.
+static const uint32_t Version = 5;
+static const size_t HeaderSize = sizeof(Magic) + 4 + 4;
+static const size_t KeySize = 16;
+// Key, offset and size of the entry.
+static const size_t IndexEntrySize = KeySize + 8 + 8;
+// Size recorded for files that don't exist.
+static const uint64_t MissingFile = UINT64_MAX;
+// Modification time recorded for files that changed while they were read, no
+// file on disk matches it.
+static const int64_t ChangedFile = INT64_MIN;
+
+// Maps the cache file at path and finds its index, returns null if there is no
+// valid cache there.
+static std::unique_ptr<MemoryBuffer> openCache(StringRef path, StringRef &index, uint32_t &entryCount) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(path, -1, /*RequiresNullTerminator=*/false);
+  if (!file) {
+    return nullptr;
+  }
+  BinaryReader reader((*file)->getBuffer());
+  if (reader.readBytes(sizeof(Magic)) != StringRef(Magic, sizeof(Magic)) || reader.read32() != Version) {
+    return nullptr;
+  }
+  uint32_t count = reader.read32();
+  StringRef entries = reader.readBytes(size_t(count) * IndexEntrySize);
+  if (reader.failed()) {
+    return nullptr;
+  }
+  index = entries;
+  entryCount = count;
+  return std::move(*file);
+}
+
+// The record an index entry points to, empty if it is out of bounds.
+static StringRef recordFor(StringRef data, StringRef indexEntry) {
+  BinaryReader reader(indexEntry.drop_front(KeySize));
+  uint64_t offset = reader.read64();
+  uint64_t size = reader.read64();
+  if (offset > data.size() || size > data.size() - offset) {
+    return StringRef();
+  }
+  return data.substr(offset, size);
+}
+
+ResultCache::ResultCache(std::string path) : path(std::move(path)) {
+  buffer = openCache(this->path, index, entryCount);
+}
+
+ResultCache::~ResultCache() {
+  if (spill) {
+    spill->close();
+    sys::fs::remove(spillPath);
+  }
+}
+
+std::string ResultCache::makeKey(StringRef command, StringRef mainFileContents) {
+  MD5 hash;
+  hash.update(command);
+  hash.update(mainFileContents);
+  MD5::MD5Result result;
+  hash.final(result);
+  return std::string(reinterpret_cast<const char *>(result.Bytes.data()), KeySize);
+}
+
+StringRef ResultCache::entryAt(uint32_t position) const {
+  return index.substr(size_t(position) * IndexEntrySize, IndexEntrySize);
+}
+
+StringRef ResultCache::findEntry(StringRef key) const {
+  uint32_t low = 0;
+  uint32_t high = entryCount;
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    StringRef entry = entryAt(middle);
+    int comparison = entry.take_front(KeySize).compare(key);
+    if (comparison == 0) {
+      return recordFor(buffer->getBuffer(), entry);
+    }
+    if (comparison < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return StringRef();
+}
+
+static int64_t nanoseconds(sys::TimePoint<> time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+FileStamp ResultCache::stampFile(StringRef path) {
+  FileStamp stamp = {path.str(), MissingFile, 0};
+  sys::fs::file_status status;
+  if (!sys::fs::status(path, status)) {
+    stamp.size = status.getSize();
+    stamp.modificationTime = nanoseconds(status.getLastModificationTime());
+  }
+  return stamp;
+}
+
+FileStamp ResultCache::stampFile(StringRef path, uint64_t sizeRead, int64_t secondsRead) {
+  FileStamp stamp = {path.str(), sizeRead, ChangedFile};
+  // The file is stat'ed again after it was read, it has to still be the file
+  // that was read.
+  sys::fs::file_status status;
+  if (!sys::fs::status(path, status) && status.getSize() == sizeRead &&
+      sys::toTimeT(status.getLastModificationTime()) == secondsRead) {
+    stamp.modificationTime = nanoseconds(status.getLastModificationTime());
+  }
+  return stamp;
+}
+
+bool ResultCache::isCurrent(const FileStamp &stamp) {
+  {
+    std::lock_guard<std::mutex> lock(stampsMutex);
+    auto iter = currentStamps.find(stamp.path);
+    if (iter != currentStamps.end()) {
+      return iter->second.size == stamp.size && iter->second.modificationTime == stamp.modificationTime;
+    }
+  }
+
+  FileStamp current = stampFile(stamp.path);
+  std::lock_guard<std::mutex> lock(stampsMutex);
+  currentStamps.insert(std::make_pair(stamp.path, current));
+  return current.size == stamp.size && current.modificationTime == stamp.modificationTime;
+}
+
+bool ResultCache::dependenciesCurrent(BinaryReader &reader) {
+  uint32_t dependencyCount = reader.read32();
+  for (uint32_t i = 0; i < dependencyCount && !reader.failed(); i++) {
+    FileStamp stamp;
+    stamp.path = reader.readString().str();
+    stamp.size = reader.read64();
+    stamp.modificationTime = static_cast<int64_t>(reader.read64());
+    if (reader.failed() || !isCurrent(stamp)) {
+      return false;
+    }
+  }
+  return !reader.failed();
+}
+
+bool ResultCache::lookup(StringRef key, int &status, std::vector<UnusedImport> &unusedImports) {
+  StringRef record = findEntry(key);
+  if (record.empty()) {
+    misses++;
+    return false;
+  }
+
+  BinaryReader reader(record);
+  int recordedStatus = static_cast<int>(reader.read32());
+  if (!dependenciesCurrent(reader)) {
+    misses++;
+    return false;
+  }
+
+  std::vector<UnusedImport> recordedImports;
+  uint32_t unusedCount = reader.read32();
+  for (uint32_t i = 0; i < unusedCount && !reader.failed(); i++) {
+    UnusedImport unusedImport;
+    unusedImport.name = reader.readString().str();
+    unusedImport.line = reader.read32();
+    unusedImport.symbols = reader.read32();
+    recordedImports.push_back(std::move(unusedImport));
+  }
+  if (reader.failed()) {
+    misses++;
+    return false;
+  }
+
+  status = recordedStatus;
+  unusedImports = std::move(recordedImports);
+  hits++;
+  return true;
+}
+
+void ResultCache::store(StringRef key, int status, ArrayRef<FileStamp> dependencies,
+                        ArrayRef<UnusedImport> unusedImports) {
+  std::string record;
+  BinaryWriter writer(record);
+  writer.write32(static_cast<uint32_t>(status));
+  writer.write32(static_cast<uint32_t>(dependencies.size()));
+  for (const FileStamp &stamp : dependencies) {
+    writer.writeString(stamp.path);
+    writer.write64(stamp.size);
+    writer.write64(static_cast<uint64_t>(stamp.modificationTime));
+  }
+  writer.write32(static_cast<uint32_t>(unusedImports.size()));
+  for (const UnusedImport &unusedImport : unusedImports) {
+    writer.writeString(unusedImport.name);
+    writer.write32(unusedImport.line);
+    writer.write32(unusedImport.symbols);
+  }
+
+  std::lock_guard<std::mutex> lock(updatesMutex);
+  if (!spill) {
+    int fd;
+    if (sys::fs::createTemporaryFile("objc-unused-imports-cache", "tmp", fd, spillPath)) {
+      // The cache is only an optimization, the result is recomputed next time.
+      return;
+    }
+    spill = llvm::make_unique<raw_fd_ostream>(fd, /*shouldClose=*/true);
+  }
+  *spill << record;
+  updates[key.str()] = std::make_pair(spillSize, uint64_t(record.size()));
+  spillSize += record.size();
+}
+
+std::error_code ResultCache::save() {
+  std::lock_guard<std::mutex> lock(updatesMutex);
+  if (updates.empty()) {
+    return std::error_code();
+  }
+  spill->close();
+  bool spillFailed = spill->has_error();
+  spill->clear_error();
+  spill.reset();
+  ErrorOr<std::unique_ptr<MemoryBuffer>> spilled = MemoryBuffer::getFile(spillPath, -1, /*RequiresNullTerminator=*/false);
+  sys::fs::remove(spillPath);
+  std::map<std::string, std::pair<uint64_t, uint64_t>> spilledRecords;
+  spilledRecords.swap(updates);
+  spillSize = 0;
+  if (spillFailed || !spilled) {
+    return std::make_error_code(std::errc::io_error);
+  }
+  StringRef spilledData = (*spilled)->getBuffer();
+
+  // Runs sharing the cache save one at a time, each merging its results into
+  // what the others saved since it started. If the lock can't be taken, the
+  // file is still replaced atomically, but results saved concurrently may be
+  // lost.
+  Optional<LockFileManager> fileLock;
+  while (true) {
+    fileLock.emplace(path);
+    if (*fileLock != LockFileManager::LFS_Shared) {
+      break;
+    }
+    if (fileLock->waitForUnlock() == LockFileManager::Res_Timeout) {
+      fileLock->unsafeRemoveLockFile();
+    }
+  }
+  StringRef currentIndex;
+  uint32_t currentCount = 0;
+  std::unique_ptr<MemoryBuffer> current = openCache(path, currentIndex, currentCount);
+
+  // Entries of TUs that weren't analyzed this time are kept while the files
+  // they read are unchanged. The others can never be used again: a changed
+  // main file gets a new key.
+  std::map<StringRef, StringRef> records;
+  for (uint32_t i = 0; i < currentCount; i++) {
+    StringRef entry = currentIndex.substr(size_t(i) * IndexEntrySize, IndexEntrySize);
+    StringRef record = recordFor(current->getBuffer(), entry);
+    BinaryReader reader(record);
+    reader.read32();
+    if (!record.empty() && dependenciesCurrent(reader)) {
+      records[entry.take_front(KeySize)] = record;
+    }
+  }
+  for (auto &update : spilledRecords) {
+    StringRef record = spilledData.substr(update.second.first, update.second.second);
+    if (record.size() != update.second.second) {
+      return std::make_error_code(std::errc::io_error);
+    }
+    records[update.first] = record;
+  }
+
+  std::string output;
+  BinaryWriter writer(output);
+  writer.writeBytes(StringRef(Magic, sizeof(Magic)));
+  writer.write32(Version);
+  writer.write32(static_cast<uint32_t>(records.size()));
+  uint64_t offset = HeaderSize + records.size() * IndexEntrySize;
+  for (auto &record : records) {
+    writer.writeBytes(record.first);
+    writer.write64(offset);
+    writer.write64(record.second.size());
+    offset += record.second.size();
+  }
+
+  // Write next to the cache and rename over it, so a concurrent or interrupted
+  // run never sees a partial file.
+  int fd;
+  SmallString<128> temporaryPath;
+  if (std::error_code error = sys::fs::createUniqueFile(path + ".tmp-%%%%%%", fd, temporaryPath)) {
+    return error;
+  }
+  {
+    raw_fd_ostream stream(fd, /*shouldClose=*/true);
+    stream << output;
+    for (auto &record : records) {
+      stream << record.second;
+    }
+    stream.close();
+    if (stream.has_error()) {
+      stream.clear_error();
+      sys::fs::remove(temporaryPath);
+      return std::make_error_code(std::errc::io_error);
+    }
+  }
+  if (std::error_code error = sys::fs::rename(temporaryPath, path)) {
+    sys::fs::remove(temporaryPath);
+    return error;
+  }
+  return std::error_code();
+}
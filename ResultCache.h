@@ -0,0 +1,104 @@
+#ifndef OBJC_UNUSED_IMPORTS_RESULT_CACHE_H
+#define OBJC_UNUSED_IMPORTS_RESULT_CACHE_H
+
+#include "Matching.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+// A file a TU read, as it was when the TU was analyzed. The modification time
+// is in nanoseconds, so a file rewritten with the same size within a second
+// doesn't keep its stamp.
+struct FileStamp {
+  std::string path;
+  uint64_t size;
+  int64_t modificationTime;
+};
+
+class BinaryReader;
+
+// Results of earlier runs, so unchanged TUs can be skipped. Each TU is keyed by
+// its compile command and main file contents. Its entry lists every file it
+// read, headers and module files included, and is only used while all of them
+// still have the recorded size and modification time. Entries that can't be
+// used anymore are dropped when the cache is saved.
+//
+// The file is a sorted index of keys followed by the entries, and is mapped
+// read-only so any number of workers can look up at once. New results are
+// appended to a temporary file as they arrive, so memory doesn't grow with the
+// number of TUs, and merged by save(), which replaces the file atomically.
+// Processes saving the same cache take turns, each keeping what the others
+// saved.
+class ResultCache {
+public:
+  // A missing or unreadable cache file starts an empty cache.
+  explicit ResultCache(std::string path);
+
+  ~ResultCache();
+
+  static std::string makeKey(llvm::StringRef command, llvm::StringRef mainFileContents);
+
+  // The file at path as it is now, or with size UINT64_MAX if it doesn't
+  // exist.
+  static FileStamp stampFile(llvm::StringRef path);
+
+  // Same, for a file that was read with the given size and modification time
+  // in seconds. If it has changed since, the stamp matches no file, so the
+  // results computed from what was read are never reused.
+  static FileStamp stampFile(llvm::StringRef path, uint64_t sizeRead, int64_t secondsRead);
+
+  bool lookup(llvm::StringRef key, int &status, std::vector<UnusedImport> &unusedImports);
+
+  void store(llvm::StringRef key, int status, llvm::ArrayRef<FileStamp> dependencies,
+             llvm::ArrayRef<UnusedImport> unusedImports);
+
+  std::error_code save();
+
+  unsigned getHitCount() const {
+    return hits;
+  }
+
+  unsigned getMissCount() const {
+    return misses;
+  }
+
+private:
+  std::string path;
+  std::unique_ptr<llvm::MemoryBuffer> buffer;
+  llvm::StringRef index;
+  uint32_t entryCount = 0;
+
+  std::mutex updatesMutex;
+  // Offset and size of each new record in the spill file.
+  std::map<std::string, std::pair<uint64_t, uint64_t>> updates;
+  std::unique_ptr<llvm::raw_fd_ostream> spill;
+  llvm::SmallString<128> spillPath;
+  uint64_t spillSize = 0;
+
+  // Files are shared by many TUs, stat each one once per run.
+  std::mutex stampsMutex;
+  llvm::StringMap<FileStamp> currentStamps;
+
+  std::atomic<unsigned> hits{0};
+  std::atomic<unsigned> misses{0};
+
+  llvm::StringRef findEntry(llvm::StringRef key) const;
+  llvm::StringRef entryAt(uint32_t position) const;
+  bool isCurrent(const FileStamp &stamp);
+  // Reads the dependencies of a record and checks them all.
+  bool dependenciesCurrent(BinaryReader &reader);
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "ResultEmitter.h"
+
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm;
+
+static std::string jsonString(StringRef string) {
+  return json::isUTF8(string) ? string.str() : json::fixUTF8(string);
+}
+
+// SARIF locations are URIs, absolute paths become file:// ones.
+static std::string fileURI(StringRef path) {
+  std::string uri = sys::path::is_absolute(path) ? "file://" : "";
+  for (char c : path) {
+    if (isalnum(static_cast<unsigned char>(c)) || StringRef("/-._~").find(c) != StringRef::npos) {
+      uri += c;
+    } else {
+      static const char hexDigits[] = "0123456789ABCDEF";
+      uri += '%';
+      uri += hexDigits[static_cast<unsigned char>(c) >> 4];
+      uri += hexDigits[static_cast<unsigned char>(c) & 15];
+    }
+  }
+  return uri;
+}
+
+static json::Object costObject(const ImportCost &cost) {
+  return json::Object{
+    {"bytes", int64_t(cost.bytes)},
+    {"tokens", int64_t(cost.tokens)},
+    {"files", int64_t(cost.files)},
+    {"seconds", cost.seconds},
+  };
+}
+
+static std::string findingMessage(const UnusedImport &finding) {
+  if (finding.forwardDeclarations.empty()) {
+    return "Unused import " + finding.name;
+  }
+  std::string message = "Import " + finding.name + " is only used through pointers, forward declare";
+  for (const std::string &forwardDeclaration : finding.forwardDeclarations) {
+    message += " " + forwardDeclaration;
+  }
+  return message + " and import it in the implementation";
+}
+
+ResultEmitter::ResultEmitter(OutputFormat format, raw_ostream &out, bool withCosts)
+  : format(format), out(out), withCosts(withCosts) {
+  if (format != OutputFormat::SARIF) {
+    return;
+  }
+  json::Array rules;
+  auto addRule = [&rules](StringRef id, StringRef description) {
+    rules.push_back(json::Object{{"id", id}, {"shortDescription", json::Object{{"text", description}}}});
+  };
+  addRule("unused-import", "The file doesn't use anything the import declares");
+  addRule("forward-declarable-import", "The header only uses the import's declarations through pointers");
+  addRule("compile-error", "The translation unit didn't compile, its results may be incomplete");
+  json::Object driver{
+    {"name", "objc-unused-imports"},
+    {"informationUri", "https://github.com/cltnschlosser/objc-unused-imports"},
+    {"rules", std::move(rules)},
+  };
+  // Everything up to the results array, which emit() appends to.
+  std::string header;
+  raw_string_ostream stream(header);
+  stream << json::Value(json::Object{{"tool", json::Object{{"driver", std::move(driver)}}}});
+  stream.flush();
+  header.pop_back();
+  out << "{\"version\":\"2.1.0\",\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\",\"runs\":["
+      << header << ",\"results\":[\n";
+  out.flush();
+}
+
+void ResultEmitter::emit(StringRef file, int status, bool cached, ArrayRef<UnusedImport> findings) {
+  if (format == OutputFormat::Text) {
+    return;
+  }
+
+  std::string records;
+  raw_string_ostream stream(records);
+  std::string fileName = jsonString(file);
+  if (format == OutputFormat::JSONLines) {
+    for (const UnusedImport &finding : findings) {
+      json::Object record{
+        {"type", "finding"},
+        {"kind", finding.forwardDeclarations.empty() ? "unused-import" : "forward-declarable-import"},
+        {"file", fileName},
+        {"line", int64_t(finding.line)},
+        {"import", jsonString(finding.name)},
+        {"symbols", int64_t(finding.symbols)},
+      };
+      if (!finding.forwardDeclarations.empty()) {
+        record["forwardDeclarations"] = json::Array(finding.forwardDeclarations);
+      }
+      if (withCosts) {
+        record["cost"] = costObject(finding.cost);
+      }
+      stream << json::Value(std::move(record)) << "\n";
+    }
+    stream << json::Value(json::Object{
+      {"type", "translationUnit"},
+      {"file", fileName},
+      {"status", status},
+      {"cached", cached},
+      {"findings", int64_t(findings.size())},
+    }) << "\n";
+  } else {
+    std::string uri = fileURI(file);
+    auto location = [&uri](unsigned line) {
+      json::Object physicalLocation{{"artifactLocation", json::Object{{"uri", uri}}}};
+      if (line) {
+        physicalLocation["region"] = json::Object{{"startLine", int64_t(line)}};
+      }
+      return json::Array{json::Object{{"physicalLocation", std::move(physicalLocation)}}};
+    };
+    std::vector<json::Value> results;
+    for (const UnusedImport &finding : findings) {
+      json::Object properties{{"import", jsonString(finding.name)}, {"symbols", int64_t(finding.symbols)}};
+      if (withCosts) {
+        properties["cost"] = costObject(finding.cost);
+      }
+      results.push_back(json::Object{
+        {"ruleId", finding.forwardDeclarations.empty() ? "unused-import" : "forward-declarable-import"},
+        {"level", "warning"},
+        {"message", json::Object{{"text", jsonString(findingMessage(finding))}}},
+        {"locations", location(finding.line)},
+        {"properties", std::move(properties)},
+      });
+    }
+    if (status != 0) {
+      results.push_back(json::Object{
+        {"ruleId", "compile-error"},
+        {"level", "error"},
+        {"message", json::Object{{"text", "The translation unit failed to compile with status " + std::to_string(status)}}},
+        {"locations", location(0)},
+      });
+    }
+    // The separator before the first result is written under the lock.
+    for (size_t i = 0; i < results.size(); i++) {
+      if (i) {
+        stream << ",\n";
+      }
+      stream << results[i];
+    }
+    if (results.empty()) {
+      return;
+    }
+  }
+  stream.flush();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (format == OutputFormat::SARIF && !firstResult) {
+    out << ",\n";
+  }
+  firstResult = false;
+  out << records;
+  out.flush();
+}
+
+bool ResultEmitter::emitRequestDone(int status, double milliseconds) {
+  if (format != OutputFormat::JSONLines) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  out << json::Value(json::Object{{"type", "done"}, {"status", status}, {"milliseconds", milliseconds}}) << "\n";
+  out.flush();
+  return true;
+}
+
+bool ResultEmitter::emitRequestError(StringRef message) {
+  if (format != OutputFormat::JSONLines) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  out << json::Value(json::Object{{"type", "error"}, {"message", jsonString(message)}}) << "\n";
+  out.flush();
+  return true;
+}
+
+void ResultEmitter::finish() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (format == OutputFormat::SARIF) {
+    out << "\n]}]}\n";
+  }
+  out.flush();
+}
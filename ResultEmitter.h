@@ -0,0 +1,48 @@
+#ifndef OBJC_UNUSED_IMPORTS_RESULT_EMITTER_H
+#define OBJC_UNUSED_IMPORTS_RESULT_EMITTER_H
+
+#include "Matching.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <mutex>
+#include <string>
+
+enum class OutputFormat {
+  Text,
+  JSONLines,
+  SARIF
+};
+
+// Writes machine-readable results while the run goes on, each TU as soon as
+// it is done. JSON Lines gets a record per finding and one per TU. SARIF is a
+// single document whose results are streamed between a header written up
+// front and a footer written by finish().
+//
+// Workers format their records on their own and only hold the lock to write
+// them out, so a slow consumer is the only thing they ever wait for.
+class ResultEmitter {
+public:
+  ResultEmitter(OutputFormat format, llvm::raw_ostream &out, bool withCosts);
+
+  void emit(llvm::StringRef file, int status, bool cached, llvm::ArrayRef<UnusedImport> findings);
+
+  // For --serve, the end of a request and a request that wasn't understood.
+  // Only JSON Lines has records for them, nothing can go between the results
+  // of a SARIF document. Return false if nothing was written.
+  bool emitRequestDone(int status, double milliseconds);
+  bool emitRequestError(llvm::StringRef message);
+
+  void finish();
+
+private:
+  OutputFormat format;
+  llvm::raw_ostream &out;
+  bool withCosts;
+  std::mutex mutex;
+  bool firstResult = true;
+};
+
+#endif
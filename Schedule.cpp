@@ -0,0 +1,196 @@
+#include "Schedule.h"
+#include "Serialization.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/LockFileManager.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
+#include <map>
+
+using namespace llvm;
+
+static const char Magic[4] = {'O', 'U', 'I', 'H'};
+static const uint32_t Version = 1;
+
+static void readHistory(StringRef path, StringMap<double> &seconds) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(path, -1, /*RequiresNullTerminator=*/false);
+  if (!file) {
+    return;
+  }
+  BinaryReader reader((*file)->getBuffer());
+  if (reader.readBytes(sizeof(Magic)) != StringRef(Magic, sizeof(Magic)) || reader.read32() != Version) {
+    return;
+  }
+  uint32_t count = reader.read32();
+  for (uint32_t i = 0; i < count && !reader.failed(); i++) {
+    StringRef file = reader.readString();
+    double fileSeconds = BitsToDouble(reader.read64());
+    if (!reader.failed()) {
+      seconds[file] = fileSeconds;
+    }
+  }
+}
+
+ScheduleHistory::ScheduleHistory(std::string path) : path(std::move(path)) {
+  readHistory(this->path, seconds);
+}
+
+double ScheduleHistory::find(StringRef file) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto entry = seconds.find(file);
+  return entry == seconds.end() ? -1 : entry->second;
+}
+
+void ScheduleHistory::record(StringRef file, double fileSeconds) {
+  std::lock_guard<std::mutex> lock(mutex);
+  seconds[file] = fileSeconds;
+  recorded[file] = fileSeconds;
+}
+
+std::error_code ScheduleHistory::save() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (recorded.empty()) {
+    return std::error_code();
+  }
+
+  // Shards sharing the history save one at a time, each adding its times to
+  // what the others saved since it started. If the lock can't be taken, the
+  // file is still replaced atomically, but times saved concurrently may be
+  // lost.
+  Optional<LockFileManager> fileLock;
+  while (true) {
+    fileLock.emplace(path);
+    if (*fileLock != LockFileManager::LFS_Shared) {
+      break;
+    }
+    if (fileLock->waitForUnlock() == LockFileManager::Res_Timeout) {
+      fileLock->unsafeRemoveLockFile();
+    }
+  }
+  StringMap<double> current;
+  readHistory(path, current);
+  for (auto &entry : recorded) {
+    current[entry.getKey()] = entry.getValue();
+  }
+
+  // Sorted, so the file only changes where the times do.
+  std::map<StringRef, double> entries;
+  for (auto &entry : current) {
+    entries[entry.getKey()] = entry.getValue();
+  }
+  std::string output;
+  BinaryWriter writer(output);
+  writer.writeBytes(StringRef(Magic, sizeof(Magic)));
+  writer.write32(Version);
+  writer.write32(static_cast<uint32_t>(entries.size()));
+  for (auto &entry : entries) {
+    writer.writeString(entry.first);
+    writer.write64(DoubleToBits(entry.second));
+  }
+
+  // Write next to the history and rename over it, so a shard reading it never
+  // sees a partial file.
+  int fd;
+  SmallString<128> temporaryPath;
+  if (std::error_code error = sys::fs::createUniqueFile(path + ".tmp-%%%%%%", fd, temporaryPath)) {
+    return error;
+  }
+  {
+    raw_fd_ostream stream(fd, /*shouldClose=*/true);
+    stream << output;
+    stream.close();
+    if (stream.has_error()) {
+      stream.clear_error();
+      sys::fs::remove(temporaryPath);
+      return std::make_error_code(std::errc::io_error);
+    }
+  }
+  if (std::error_code error = sys::fs::rename(temporaryPath, path)) {
+    sys::fs::remove(temporaryPath);
+    return error;
+  }
+  return std::error_code();
+}
+
+std::vector<size_t> scheduleByCost(const std::vector<std::string> &files, ScheduleHistory *history,
+                                   std::vector<uint64_t> sizes) {
+  if (sizes.empty()) {
+    sizes.resize(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+      sys::fs::file_size(files[i], sizes[i]);
+    }
+  }
+  std::vector<double> costs(files.size(), -1);
+  double knownSeconds = 0;
+  double knownSize = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (history) {
+      costs[i] = history->find(files[i]);
+    }
+    if (costs[i] >= 0) {
+      knownSeconds += costs[i];
+      knownSize += sizes[i];
+    }
+  }
+  // Without any history, sizes order the files just as well as estimates.
+  double secondsPerUnit = knownSize > 0 ? knownSeconds / knownSize : 1;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (costs[i] < 0) {
+      costs[i] = sizes[i] * secondsPerUnit;
+    }
+  }
+
+  std::vector<size_t> order(files.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&costs](size_t lhs, size_t rhs) {
+    return costs[lhs] > costs[rhs];
+  });
+  return order;
+}
+
+RunTimeline::RunTimeline(size_t count) : start(std::chrono::steady_clock::now()), times(count) {}
+
+void RunTimeline::record(size_t index, TimePoint begin, TimePoint end) {
+  times[index] = std::make_pair(std::chrono::duration<double>(begin - start).count(),
+                                std::chrono::duration<double>(end - start).count());
+}
+
+void RunTimeline::print(raw_ostream &out, unsigned workers) const {
+  if (times.empty()) {
+    return;
+  }
+  std::vector<double> durations;
+  double lastStart = 0;
+  double wallTime = 0;
+  for (auto &time : times) {
+    durations.push_back(time.second - time.first);
+    lastStart = std::max(lastStart, time.first);
+    wallTime = std::max(wallTime, time.second);
+  }
+  // Once the last TU has started, every worker that finishes stays idle.
+  double firstIdle = wallTime;
+  for (auto &time : times) {
+    if (time.second >= lastStart) {
+      firstIdle = std::min(firstIdle, time.second);
+    }
+  }
+  std::sort(durations.begin(), durations.end());
+  auto percentile = [&durations](double fraction) {
+    size_t rank = static_cast<size_t>(fraction * durations.size());
+    return durations[std::min(rank, durations.size() - 1)];
+  };
+
+  out << "Schedule: " << times.size() << " translation units on " << workers << " workers\n";
+  out << format("  Wall time: %.2f s\n", wallTime);
+  out << format("  Translation unit time: p50 %.3f s, p90 %.3f s, p99 %.3f s, max %.3f s\n", percentile(0.5),
+                percentile(0.9), percentile(0.99), durations.back());
+  double tail = wallTime - firstIdle;
+  out << format("  Tail with idle workers: %.2f s (%.1f%% of the wall time)\n", tail,
+                wallTime > 0 ? 100 * tail / wallTime : 0.0);
+}
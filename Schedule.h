@@ -0,0 +1,68 @@
+#ifndef OBJC_UNUSED_IMPORTS_SCHEDULE_H
+#define OBJC_UNUSED_IMPORTS_SCHEDULE_H
+
+#include "Stats.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// How long each TU took to analyze in earlier runs, for --schedule-history.
+// Files that weren't analyzed this time keep their old times, so shards and
+// runs over a few files can share one history. save() merges the times
+// recorded by this run into the file as it is then.
+class ScheduleHistory {
+public:
+  // A missing or unreadable file starts an empty history.
+  explicit ScheduleHistory(std::string path);
+
+  // Seconds the file took the last time it was analyzed, negative if it never
+  // was.
+  double find(llvm::StringRef file);
+
+  // Only TUs that were parsed should be recorded, a cached or skipped one
+  // says nothing about how long parsing takes.
+  void record(llvm::StringRef file, double seconds);
+
+  std::error_code save();
+
+private:
+  std::string path;
+  std::mutex mutex;
+  llvm::StringMap<double> seconds;
+  // Times recorded by this run, the only ones save() writes over.
+  llvm::StringMap<double> recorded;
+};
+
+// The order to start `files` in, the most expensive first, so the largest TUs
+// don't end up running alone at the end of a parallel run. Files without a
+// history are estimated from `sizes`, scaled by the seconds per unit of the
+// files that have one. Sizes are those of the main files unless the caller
+// has a better measure.
+std::vector<size_t> scheduleByCost(const std::vector<std::string> &files, ScheduleHistory *history,
+                                   std::vector<uint64_t> sizes = std::vector<uint64_t>());
+
+// When each TU of a run started and finished. Every index is written by the
+// one worker that analyzes it, so recording needs no lock.
+class RunTimeline {
+public:
+  explicit RunTimeline(size_t count);
+
+  void record(size_t index, TimePoint begin, TimePoint end);
+
+  // Wall time, percentiles of the TU times and the tail: how long the run went
+  // on after the first worker found nothing left to start.
+  void print(llvm::raw_ostream &out, unsigned workers) const;
+
+private:
+  TimePoint start;
+  std::vector<std::pair<double, double>> times;
+};
+
+#endif
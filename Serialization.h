@@ -0,0 +1,112 @@
+#ifndef OBJC_UNUSED_IMPORTS_SERIALIZATION_H
+#define OBJC_UNUSED_IMPORTS_SERIALIZATION_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+
+#include <cstdint>
+#include <string>
+
+// Little-endian encoding shared by the on-disk formats. Strings are a 32-bit
+// length followed by their bytes.
+class BinaryWriter {
+public:
+  explicit BinaryWriter(std::string &output) : output(output) {}
+
+  void write32(uint32_t value) {
+    char bytes[4];
+    llvm::support::endian::write32le(bytes, value);
+    output.append(bytes, sizeof(bytes));
+  }
+
+  void write64(uint64_t value) {
+    char bytes[8];
+    llvm::support::endian::write64le(bytes, value);
+    output.append(bytes, sizeof(bytes));
+  }
+
+  void writeString(llvm::StringRef string) {
+    write32(static_cast<uint32_t>(string.size()));
+    output.append(string.data(), string.size());
+  }
+
+  void writeBytes(llvm::StringRef bytes) {
+    output.append(bytes.data(), bytes.size());
+  }
+
+  // Overwrites a value written earlier, for counts and offsets that are only
+  // known once what follows them has been written.
+  void patch32(size_t offset, uint32_t value) {
+    llvm::support::endian::write32le(&output[offset], value);
+  }
+
+  size_t size() const {
+    return output.size();
+  }
+
+private:
+  std::string &output;
+};
+
+// Reads what a BinaryWriter wrote, usually straight out of a mapped file.
+// Reading past the end returns zeros and marks the reader as failed, so a
+// truncated or corrupt file is detected once with failed() instead of at every
+// read.
+class BinaryReader {
+public:
+  explicit BinaryReader(llvm::StringRef data) : position(data.begin()), end(data.end()) {}
+
+  uint32_t read32() {
+    if (!canRead(4)) {
+      return 0;
+    }
+    uint32_t value = llvm::support::endian::read32le(position);
+    position += 4;
+    return value;
+  }
+
+  uint64_t read64() {
+    if (!canRead(8)) {
+      return 0;
+    }
+    uint64_t value = llvm::support::endian::read64le(position);
+    position += 8;
+    return value;
+  }
+
+  llvm::StringRef readString() {
+    return readBytes(read32());
+  }
+
+  llvm::StringRef readBytes(size_t size) {
+    if (!canRead(size)) {
+      return llvm::StringRef();
+    }
+    llvm::StringRef bytes(position, size);
+    position += size;
+    return bytes;
+  }
+
+  bool failed() const {
+    return hasFailed;
+  }
+
+  bool atEnd() const {
+    return position == end;
+  }
+
+private:
+  const char *position;
+  const char *end;
+  bool hasFailed = false;
+
+  bool canRead(size_t size) {
+    if (hasFailed || static_cast<size_t>(end - position) < size) {
+      hasFailed = true;
+      return false;
+    }
+    return true;
+  }
+};
+
+#endif
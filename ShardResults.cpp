@@ -0,0 +1,191 @@
+#include "ShardResults.h"
+#include "Serialization.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+static const char Magic[4] = {'O', 'U', 'I', 'S'};
+static const uint32_t Version = 2;
+
+bool parseShardSpec(StringRef spec, unsigned &index, unsigned &count) {
+  std::pair<StringRef, StringRef> parts = spec.split('/');
+  if (parts.first.getAsInteger(10, index) || parts.second.getAsInteger(10, count)) {
+    return false;
+  }
+  return index >= 1 && index <= count;
+}
+
+std::vector<std::string> filesOfShard(std::vector<std::string> files, unsigned index, unsigned count) {
+  std::sort(files.begin(), files.end());
+  files.erase(std::unique(files.begin(), files.end()), files.end());
+  std::vector<std::string> shardFiles;
+  for (size_t i = index - 1; i < files.size(); i += count) {
+    shardFiles.push_back(std::move(files[i]));
+  }
+  return shardFiles;
+}
+
+static void writeStats(BinaryWriter &writer, const TUStats &stats) {
+  for (uint64_t visits : stats.visits) {
+    writer.write64(visits);
+  }
+  for (uint64_t symbolsInserted : stats.symbolsInserted) {
+    writer.write64(symbolsInserted);
+  }
+  const uint64_t counters[] = {
+    stats.traversedDeclarations, stats.traversedStatements, stats.macroExpansions, stats.macroDefinitions,
+    stats.fileClassifierHits, stats.fileClassifierMisses, stats.selectorNameHits, stats.selectorNameMisses,
+    stats.moduleIndexHits, stats.moduleIndexMisses, stats.preamblesUsed, stats.resultsCached,
+    stats.translationUnits, stats.residentBytes,
+  };
+  for (uint64_t counter : counters) {
+    writer.write64(counter);
+  }
+  for (double seconds : stats.phaseSeconds) {
+    writer.write64(DoubleToBits(seconds));
+  }
+}
+
+static void readStats(BinaryReader &reader, TUStats &stats) {
+  for (uint64_t &visits : stats.visits) {
+    visits = reader.read64();
+  }
+  for (uint64_t &symbolsInserted : stats.symbolsInserted) {
+    symbolsInserted = reader.read64();
+  }
+  uint64_t *counters[] = {
+    &stats.traversedDeclarations, &stats.traversedStatements, &stats.macroExpansions, &stats.macroDefinitions,
+    &stats.fileClassifierHits, &stats.fileClassifierMisses, &stats.selectorNameHits, &stats.selectorNameMisses,
+    &stats.moduleIndexHits, &stats.moduleIndexMisses, &stats.preamblesUsed, &stats.resultsCached,
+    &stats.translationUnits, &stats.residentBytes,
+  };
+  for (uint64_t *counter : counters) {
+    *counter = reader.read64();
+  }
+  for (double &seconds : stats.phaseSeconds) {
+    seconds = BitsToDouble(reader.read64());
+  }
+}
+
+static void writeResult(BinaryWriter &writer, const TUResult &result) {
+  writer.writeString(result.file);
+  writer.write32(static_cast<uint32_t>(result.status));
+  writer.write32(result.cached);
+  writer.writeString(result.diagnostics);
+  writer.writeString(result.debugOutput);
+  writer.write64(result.collectionAllocations);
+  writer.write64(result.internedNames);
+  writer.write64(result.nameTableBytes);
+  writeStats(writer, result.stats);
+
+  writer.write32(result.unusedImports.size());
+  for (const UnusedImport &unusedImport : result.unusedImports) {
+    writer.writeString(unusedImport.name);
+    writer.write32(unusedImport.line);
+    writer.write32(unusedImport.symbols);
+    writer.write64(unusedImport.cost.bytes);
+    writer.write64(unusedImport.cost.tokens);
+    writer.write64(unusedImport.cost.files);
+    writer.write64(DoubleToBits(unusedImport.cost.seconds));
+    writer.write32(unusedImport.forwardDeclarations.size());
+    for (const std::string &forwardDeclaration : unusedImport.forwardDeclarations) {
+      writer.writeString(forwardDeclaration);
+    }
+  }
+}
+
+static bool readResult(BinaryReader &reader, TUResult &result) {
+  result.file = reader.readString().str();
+  result.status = static_cast<int>(reader.read32());
+  result.cached = reader.read32() != 0;
+  result.diagnostics = reader.readString().str();
+  result.debugOutput = reader.readString().str();
+  result.collectionAllocations = reader.read64();
+  result.internedNames = reader.read64();
+  result.nameTableBytes = reader.read64();
+  readStats(reader, result.stats);
+
+  uint32_t unusedImportCount = reader.read32();
+  for (uint32_t i = 0; i < unusedImportCount && !reader.failed(); i++) {
+    UnusedImport unusedImport;
+    unusedImport.name = reader.readString().str();
+    unusedImport.line = reader.read32();
+    unusedImport.symbols = reader.read32();
+    unusedImport.cost.bytes = reader.read64();
+    unusedImport.cost.tokens = reader.read64();
+    unusedImport.cost.files = reader.read64();
+    unusedImport.cost.seconds = BitsToDouble(reader.read64());
+    uint32_t forwardDeclarationCount = reader.read32();
+    for (uint32_t j = 0; j < forwardDeclarationCount && !reader.failed(); j++) {
+      unusedImport.forwardDeclarations.push_back(reader.readString().str());
+    }
+    result.unusedImports.push_back(std::move(unusedImport));
+  }
+  return !reader.failed() && reader.atEnd();
+}
+
+ShardResultsWriter::ShardResultsWriter(StringRef path, unsigned index, unsigned count, std::error_code &error)
+  : stream(path, error, sys::fs::F_None) {
+  if (!error) {
+    std::string header;
+    BinaryWriter writer(header);
+    writer.writeBytes(StringRef(Magic, sizeof(Magic)));
+    writer.write32(Version);
+    writer.write32(index);
+    writer.write32(count);
+    stream << header;
+  }
+}
+
+void ShardResultsWriter::add(const TUResult &result) {
+  std::string block;
+  BinaryWriter writer(block);
+  writer.write64(0);
+  writeResult(writer, result);
+  char size[8];
+  support::endian::write64le(size, block.size() - sizeof(size));
+  block.replace(0, sizeof(size), size, sizeof(size));
+
+  std::lock_guard<std::mutex> lock(mutex);
+  stream << block;
+}
+
+std::error_code ShardResultsWriter::close() {
+  std::lock_guard<std::mutex> lock(mutex);
+  stream.close();
+  std::error_code error = stream.error();
+  stream.clear_error();
+  return error;
+}
+
+bool readShardResults(StringRef path, ShardResults &shard, std::string &error) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(path, -1, /*RequiresNullTerminator=*/false);
+  if (!file) {
+    error = file.getError().message();
+    return false;
+  }
+
+  BinaryReader reader((*file)->getBuffer());
+  if (reader.readBytes(sizeof(Magic)) != StringRef(Magic, sizeof(Magic)) || reader.read32() != Version) {
+    error = "not a shard result file, or written by another version";
+    return false;
+  }
+  shard.index = reader.read32();
+  shard.count = reader.read32();
+  while (!reader.atEnd()) {
+    uint64_t size = reader.read64();
+    BinaryReader block(reader.readBytes(size));
+    TUResult result;
+    if (reader.failed() || !readResult(block, result)) {
+      error = "truncated or corrupt shard result file";
+      return false;
+    }
+    shard.results.push_back(std::move(result));
+  }
+  return true;
+}
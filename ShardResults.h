@@ -0,0 +1,66 @@
+#ifndef OBJC_UNUSED_IMPORTS_SHARD_RESULTS_H
+#define OBJC_UNUSED_IMPORTS_SHARD_RESULTS_H
+
+#include "Matching.h"
+#include "Stats.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// Everything the report needs from one TU.
+struct TUResult {
+  std::string file;
+  int status = 0;
+  std::vector<UnusedImport> unusedImports;
+  // Errors the visitors ran into while collecting symbols.
+  std::string diagnostics;
+  std::string debugOutput;
+  uint64_t collectionAllocations = 0;
+  size_t internedNames = 0;
+  size_t nameTableBytes = 0;
+  // Replayed from --cache without parsing.
+  bool cached = false;
+  TUStats stats;
+};
+
+// Parses `i/n` with 1 <= i <= n. Returns false if `spec` isn't one.
+bool parseShardSpec(llvm::StringRef spec, unsigned &index, unsigned &count);
+
+// The files of shard `index` of `count`. Files are sorted first, so every
+// process picks the same ones whatever order the compilation database lists
+// them in, and then dealt out in turn, so files of the same directory end up
+// spread over the shards.
+std::vector<std::string> filesOfShard(std::vector<std::string> files, unsigned index, unsigned count);
+
+// Writes the results of a shard for --merge-shards. Like a symbol dump, the
+// file is a header naming the shard followed by one size-prefixed block per
+// TU, added from any thread as TUs finish.
+class ShardResultsWriter {
+public:
+  ShardResultsWriter(llvm::StringRef path, unsigned index, unsigned count, std::error_code &error);
+
+  void add(const TUResult &result);
+
+  std::error_code close();
+
+private:
+  llvm::raw_fd_ostream stream;
+  std::mutex mutex;
+};
+
+struct ShardResults {
+  unsigned index = 0;
+  unsigned count = 0;
+  std::vector<TUResult> results;
+};
+
+// Returns false and sets `error` if the file can't be read or is corrupt.
+bool readShardResults(llvm::StringRef path, ShardResults &shard, std::string &error);
+
+#endif
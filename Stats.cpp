@@ -0,0 +1,227 @@
+#include "Stats.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+StringRef visitKindToString(VisitKind kind) {
+  switch (kind) {
+    case VisitKind::ImportDecl:
+      return "ImportDecl";
+    case VisitKind::ObjCInterfaceDecl:
+      return "ObjCInterfaceDecl";
+    case VisitKind::ObjCImplementationDecl:
+      return "ObjCImplementationDecl";
+    case VisitKind::TypedefDecl:
+      return "TypedefDecl";
+    case VisitKind::RecordDecl:
+      return "RecordDecl";
+    case VisitKind::VarDecl:
+      return "VarDecl";
+    case VisitKind::FunctionDecl:
+      return "FunctionDecl";
+    case VisitKind::EnumDecl:
+      return "EnumDecl";
+    case VisitKind::EnumConstantDecl:
+      return "EnumConstantDecl";
+    case VisitKind::ObjCProtocolDecl:
+      return "ObjCProtocolDecl";
+    case VisitKind::ObjCCategoryDecl:
+      return "ObjCCategoryDecl";
+    case VisitKind::ObjCCategoryImplDecl:
+      return "ObjCCategoryImplDecl";
+    case VisitKind::ObjCMethodDecl:
+      return "ObjCMethodDecl";
+    case VisitKind::ObjCMessageExpr:
+      return "ObjCMessageExpr";
+    case VisitKind::ObjCPropertyDecl:
+      return "ObjCPropertyDecl";
+    case VisitKind::ObjCPropertyRefExpr:
+      return "ObjCPropertyRefExpr";
+    case VisitKind::ParmVarDecl:
+      return "ParmVarDecl";
+    case VisitKind::DeclRefExpr:
+      return "DeclRefExpr";
+  }
+  return "Unknown";
+}
+
+StringRef phaseToString(Phase phase) {
+  switch (phase) {
+    case Phase::CacheLookup:
+      return "Cache lookup";
+    case Phase::Frontend:
+      return "Frontend";
+    case Phase::Traversal:
+      return "Traversal";
+    case Phase::PreprocessorCallbacks:
+      return "Preprocessor callbacks";
+    case Phase::Matching:
+      return "Matching";
+  }
+  return "Unknown";
+}
+
+void TUStats::add(const TUStats &other) {
+  for (unsigned i = 0; i < VisitKindCount; i++) {
+    visits[i] += other.visits[i];
+  }
+  for (unsigned i = 0; i < SymbolTypeCount; i++) {
+    symbolsInserted[i] += other.symbolsInserted[i];
+  }
+  traversedDeclarations += other.traversedDeclarations;
+  traversedStatements += other.traversedStatements;
+  macroExpansions += other.macroExpansions;
+  macroDefinitions += other.macroDefinitions;
+  fileClassifierHits += other.fileClassifierHits;
+  fileClassifierMisses += other.fileClassifierMisses;
+  selectorNameHits += other.selectorNameHits;
+  selectorNameMisses += other.selectorNameMisses;
+  moduleIndexHits += other.moduleIndexHits;
+  moduleIndexMisses += other.moduleIndexMisses;
+  preamblesUsed += other.preamblesUsed;
+  resultsCached += other.resultsCached;
+  translationUnits += other.translationUnits;
+  residentBytes = std::max(residentBytes, other.residentBytes);
+  for (unsigned i = 0; i < PhaseCount; i++) {
+    phaseSeconds[i] += other.phaseSeconds[i];
+  }
+}
+
+static void printHitRate(raw_ostream &out, StringRef name, uint64_t hits, uint64_t misses) {
+  uint64_t total = hits + misses;
+  out << "  " << name << ": " << hits << " hits, " << misses << " misses";
+  if (total) {
+    out << format(" (%.1f%%)", 100.0 * hits / total);
+  }
+  out << "\n";
+}
+
+void TUStats::print(raw_ostream &out) const {
+  out << "  Visits:";
+  for (unsigned i = 0; i < VisitKindCount; i++) {
+    if (visits[i]) {
+      out << " " << visitKindToString(static_cast<VisitKind>(i)) << "=" << visits[i];
+    }
+  }
+  out << "\n  Symbols inserted:";
+  for (unsigned i = 0; i < SymbolTypeCount; i++) {
+    if (symbolsInserted[i]) {
+      out << " " << symbolTypeToString(static_cast<SymbolType>(i)) << "=" << symbolsInserted[i];
+    }
+  }
+  out << "\n  Traversed " << traversedDeclarations << " declarations and " << traversedStatements << " statements\n";
+  out << "  Macros: " << macroExpansions << " expansions, " << macroDefinitions << " definitions\n";
+  printHitRate(out, "File classifier", fileClassifierHits, fileClassifierMisses);
+  printHitRate(out, "Selector names", selectorNameHits, selectorNameMisses);
+  if (moduleIndexHits || moduleIndexMisses) {
+    printHitRate(out, "Module export index", moduleIndexHits, moduleIndexMisses);
+  }
+  if (translationUnits > 1) {
+    out << "  Translation units: " << translationUnits << ", " << preamblesUsed << " with a shared preamble, "
+        << resultsCached << " replayed from the cache\n";
+  }
+
+  if (residentBytes) {
+    out << format(translationUnits > 1 ? "  Resident memory after the largest TU: %.1f MB\n" : "  Resident memory after the TU: %.1f MB\n",
+                  residentBytes / 1048576.0);
+  }
+
+  double frontend = phaseSeconds[static_cast<size_t>(Phase::Frontend)];
+  double traversal = phaseSeconds[static_cast<size_t>(Phase::Traversal)];
+  double callbacks = phaseSeconds[static_cast<size_t>(Phase::PreprocessorCallbacks)];
+  out << format("  Time: cache lookup %.3fs, frontend %.3fs (parsing %.3fs, traversal %.3fs, preprocessor callbacks %.3fs), matching %.3fs\n",
+                phaseSeconds[static_cast<size_t>(Phase::CacheLookup)], frontend,
+                std::max(0.0, frontend - traversal - callbacks), traversal, callbacks,
+                phaseSeconds[static_cast<size_t>(Phase::Matching)]);
+}
+
+uint64_t getCurrentResidentBytes() {
+#if defined(__APPLE__)
+  mach_task_basic_info_data_t info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+    return 0;
+  }
+  return info.resident_size;
+#elif defined(__linux__)
+  FILE *file = fopen("/proc/self/statm", "r");
+  if (!file) {
+    return 0;
+  }
+  unsigned long long pages = 0;
+  unsigned long long residentPages = 0;
+  int fields = fscanf(file, "%llu %llu", &pages, &residentPages);
+  fclose(file);
+  return fields == 2 ? residentPages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+#else
+  return 0;
+#endif
+}
+
+uint64_t getPeakResidentBytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  // Bytes on macOS, kilobytes everywhere else.
+#if defined(__APPLE__)
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+void TimeTrace::add(StringRef name, StringRef detail, TimePoint begin, TimePoint end) {
+  Event event;
+  event.name = name.str();
+  event.detail = detail.str();
+  event.beginMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(begin - start).count();
+  event.durationMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto inserted = threads.insert(std::make_pair(std::this_thread::get_id(), unsigned(threads.size())));
+  event.thread = inserted.first->second;
+  events.push_back(std::move(event));
+}
+
+std::error_code TimeTrace::write(StringRef path) {
+  std::lock_guard<std::mutex> lock(mutex);
+  json::Array traceEvents;
+  for (const Event &event : events) {
+    json::Object traceEvent{
+      {"name", event.name},
+      {"ph", "X"},
+      {"pid", 1},
+      {"tid", int64_t(event.thread)},
+      {"ts", int64_t(event.beginMicroseconds)},
+      {"dur", int64_t(event.durationMicroseconds)},
+    };
+    if (!event.detail.empty()) {
+      traceEvent["args"] = json::Object{{"detail", event.detail}};
+    }
+    traceEvents.push_back(std::move(traceEvent));
+  }
+
+  std::error_code error;
+  raw_fd_ostream out(path, error, sys::fs::F_None);
+  if (error) {
+    return error;
+  }
+  out << json::Value(json::Object{{"traceEvents", std::move(traceEvents)}});
+  out.close();
+  error = out.error();
+  out.clear_error();
+  return error;
+}
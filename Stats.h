@@ -0,0 +1,153 @@
+#ifndef OBJC_UNUSED_IMPORTS_STATS_H
+#define OBJC_UNUSED_IMPORTS_STATS_H
+
+#include "SymbolTable.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// The Visit* methods of ObjcClassVisitor.
+enum class VisitKind : uint8_t {
+  ImportDecl,
+  ObjCInterfaceDecl,
+  ObjCImplementationDecl,
+  TypedefDecl,
+  RecordDecl,
+  VarDecl,
+  FunctionDecl,
+  EnumDecl,
+  EnumConstantDecl,
+  ObjCProtocolDecl,
+  ObjCCategoryDecl,
+  ObjCCategoryImplDecl,
+  ObjCMethodDecl,
+  ObjCMessageExpr,
+  ObjCPropertyDecl,
+  ObjCPropertyRefExpr,
+  ParmVarDecl,
+  DeclRefExpr
+};
+
+static const unsigned VisitKindCount = 18;
+
+llvm::StringRef visitKindToString(VisitKind kind);
+
+// Timed phases of a TU. Traversal and preprocessor callbacks run inside the
+// frontend, whatever is left of the frontend's time is lexing, parsing and
+// semantic analysis.
+enum class Phase : uint8_t {
+  CacheLookup,
+  Frontend,
+  Traversal,
+  PreprocessorCallbacks,
+  Matching
+};
+
+static const unsigned PhaseCount = 5;
+
+llvm::StringRef phaseToString(Phase phase);
+
+// Counters for --print-stats, one set per TU. They are cheap enough to always
+// be collected, only the timers are skipped when nothing asked for them.
+struct TUStats {
+  uint64_t visits[VisitKindCount] = {};
+  uint64_t symbolsInserted[SymbolTypeCount] = {};
+  uint64_t traversedDeclarations = 0;
+  uint64_t traversedStatements = 0;
+  uint64_t macroExpansions = 0;
+  uint64_t macroDefinitions = 0;
+  uint64_t fileClassifierHits = 0;
+  uint64_t fileClassifierMisses = 0;
+  uint64_t selectorNameHits = 0;
+  uint64_t selectorNameMisses = 0;
+  uint64_t moduleIndexHits = 0;
+  uint64_t moduleIndexMisses = 0;
+  // TUs that loaded a shared preamble or were replayed from --cache. Always 0
+  // or 1 for a single TU, counts once TUs are added up.
+  uint64_t preamblesUsed = 0;
+  uint64_t resultsCached = 0;
+  uint64_t translationUnits = 0;
+  // Resident memory of the process right after the TU, the largest of them
+  // once TUs are added up. Only sampled for --print-stats.
+  uint64_t residentBytes = 0;
+  double phaseSeconds[PhaseCount] = {};
+
+  void add(const TUStats &other);
+
+  void print(llvm::raw_ostream &out) const;
+};
+
+// Resident memory of the process in bytes, 0 where it can't be read.
+uint64_t getCurrentResidentBytes();
+
+uint64_t getPeakResidentBytes();
+
+typedef std::chrono::steady_clock::time_point TimePoint;
+
+// Chrome trace events (chrome://tracing, Perfetto) for --time-trace. Each
+// worker thread gets its own track.
+class TimeTrace {
+public:
+  TimeTrace() : start(std::chrono::steady_clock::now()) {}
+
+  void add(llvm::StringRef name, llvm::StringRef detail, TimePoint begin, TimePoint end);
+
+  std::error_code write(llvm::StringRef path);
+
+private:
+  struct Event {
+    std::string name;
+    std::string detail;
+    uint64_t beginMicroseconds;
+    uint64_t durationMicroseconds;
+    unsigned thread;
+  };
+
+  TimePoint start;
+  std::mutex mutex;
+  std::vector<Event> events;
+  std::map<std::thread::id, unsigned> threads;
+};
+
+// Adds the time until it is destroyed to a phase of `stats`, and to `trace`
+// if there is one. With neither it doesn't read the clock at all.
+class PhaseTimer {
+public:
+  PhaseTimer(TUStats *stats, Phase phase, TimeTrace *trace = nullptr, llvm::StringRef detail = llvm::StringRef())
+    : stats(stats), phase(phase), trace(trace), detail(detail) {
+    if (stats || trace) {
+      begin = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~PhaseTimer() {
+    if (!stats && !trace) {
+      return;
+    }
+    TimePoint end = std::chrono::steady_clock::now();
+    if (stats) {
+      stats->phaseSeconds[static_cast<size_t>(phase)] += std::chrono::duration<double>(end - begin).count();
+    }
+    if (trace) {
+      trace->add(phaseToString(phase), detail, begin, end);
+    }
+  }
+
+private:
+  TUStats *stats;
+  Phase phase;
+  TimeTrace *trace;
+  llvm::StringRef detail;
+  TimePoint begin;
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include "SymbolDump.h"
+#include "Serialization.h"
+
+#include "llvm/Support/FileSystem.h"
+
+using namespace llvm;
+
+static const char Magic[4] = {'O', 'U', 'I', 'D'};
+static const uint32_t Version = 2;
+
+static void writeTU(BinaryWriter &writer, StringRef file, int status, const TUSymbols &symbols) {
+  writer.writeString(file);
+  writer.write32(static_cast<uint32_t>(status));
+
+  writer.write32(static_cast<uint32_t>(symbols.names.size()));
+  for (NameID name = 0; name < symbols.names.size(); name++) {
+    writer.writeString(symbols.names.name(name));
+  }
+  writer.write32(symbols.mainFile);
+
+  writer.write32(symbols.symbolsForFile.size());
+  for (auto &fileSymbols : symbols.symbolsForFile) {
+    writer.write32(fileSymbols.first);
+    writer.write32(fileSymbols.second.size());
+    for (auto &entry : fileSymbols.second) {
+      writer.write32(static_cast<uint32_t>(entry.first.type));
+      writer.write32(entry.first.name);
+      writer.write32(entry.second.size());
+      for (NameID className : entry.second) {
+        writer.write32(className);
+      }
+    }
+  }
+
+  writer.write32(symbols.lineNumbers.size());
+  for (auto &line : symbols.lineNumbers) {
+    writer.write32(line.first);
+    writer.write32(line.second);
+  }
+
+  writer.write32(symbols.modulesImported.size());
+  for (NameID module : symbols.modulesImported) {
+    writer.write32(module);
+  }
+
+  writer.write32(symbols.usedImports.size());
+  for (NameID import : symbols.usedImports) {
+    writer.write32(import);
+  }
+
+  writer.write32(symbols.superClass.size());
+  for (auto &link : symbols.superClass) {
+    writer.write32(link.first);
+    writer.write32(link.second);
+  }
+}
+
+static bool readTU(BinaryReader &reader, DumpedTU &tu) {
+  tu.file = reader.readString().str();
+  tu.status = static_cast<int>(reader.read32());
+
+  TUSymbols &symbols = tu.symbols;
+  uint32_t nameCount = reader.read32();
+  for (uint32_t i = 0; i < nameCount && !reader.failed(); i++) {
+    symbols.names.intern(reader.readString());
+  }
+  // Names are unique, so interning them in order gives back the same IDs.
+  if (reader.failed() || symbols.names.size() != nameCount) {
+    return false;
+  }
+  // Every ID is checked before it is used as a key: out of range IDs would
+  // read past the name table, and the largest two are the empty and tombstone
+  // keys of the DenseMaps.
+  auto validName = [nameCount](NameID name) {
+    return name < nameCount;
+  };
+
+  symbols.mainFile = reader.read32();
+  if (symbols.mainFile != InvalidName && !validName(symbols.mainFile)) {
+    return false;
+  }
+
+  uint32_t fileCount = reader.read32();
+  for (uint32_t i = 0; i < fileCount && !reader.failed(); i++) {
+    NameID fileName = reader.read32();
+    if (!validName(fileName)) {
+      return false;
+    }
+    SymbolSet &fileSymbols = symbols.symbolsForFile[fileName];
+    uint32_t symbolCount = reader.read32();
+    for (uint32_t j = 0; j < symbolCount && !reader.failed(); j++) {
+      uint32_t type = reader.read32();
+      NameID name = reader.read32();
+      if (type >= SymbolTypeCount || !validName(name)) {
+        return false;
+      }
+      ClassNameList &classNames = fileSymbols[Symbol{static_cast<SymbolType>(type), name}];
+      uint32_t classCount = reader.read32();
+      for (uint32_t k = 0; k < classCount && !reader.failed(); k++) {
+        NameID className = reader.read32();
+        if (!validName(className)) {
+          return false;
+        }
+        classNames.push_back(className);
+      }
+    }
+  }
+
+  uint32_t lineCount = reader.read32();
+  for (uint32_t i = 0; i < lineCount && !reader.failed(); i++) {
+    NameID name = reader.read32();
+    unsigned line = reader.read32();
+    if (!validName(name)) {
+      return false;
+    }
+    symbols.lineNumbers[name] = line;
+  }
+
+  uint32_t moduleCount = reader.read32();
+  for (uint32_t i = 0; i < moduleCount && !reader.failed(); i++) {
+    NameID module = reader.read32();
+    if (!validName(module)) {
+      return false;
+    }
+    symbols.modulesImported.insert(module);
+  }
+
+  uint32_t usedImportCount = reader.read32();
+  for (uint32_t i = 0; i < usedImportCount && !reader.failed(); i++) {
+    NameID import = reader.read32();
+    if (!validName(import)) {
+      return false;
+    }
+    symbols.usedImports.insert(import);
+  }
+
+  uint32_t superClassCount = reader.read32();
+  for (uint32_t i = 0; i < superClassCount && !reader.failed(); i++) {
+    NameID className = reader.read32();
+    NameID superClassName = reader.read32();
+    if (!validName(className) || !validName(superClassName)) {
+      return false;
+    }
+    symbols.superClass[className] = superClassName;
+  }
+
+  return !reader.failed() && reader.atEnd();
+}
+
+SymbolDumpWriter::SymbolDumpWriter(StringRef path, std::error_code &error)
+  : stream(path, error, sys::fs::F_None) {
+  if (!error) {
+    std::string header;
+    BinaryWriter writer(header);
+    writer.writeBytes(StringRef(Magic, sizeof(Magic)));
+    writer.write32(Version);
+    stream << header;
+  }
+}
+
+void SymbolDumpWriter::add(StringRef file, int status, const TUSymbols &symbols) {
+  std::string block;
+  BinaryWriter writer(block);
+  writer.write64(0);
+  writeTU(writer, file, status, symbols);
+  char size[8];
+  support::endian::write64le(size, block.size() - sizeof(size));
+  block.replace(0, sizeof(size), size, sizeof(size));
+
+  std::lock_guard<std::mutex> lock(mutex);
+  stream << block;
+}
+
+std::error_code SymbolDumpWriter::close() {
+  std::lock_guard<std::mutex> lock(mutex);
+  stream.close();
+  std::error_code error = stream.error();
+  stream.clear_error();
+  return error;
+}
+
+std::unique_ptr<SymbolDump> SymbolDump::open(StringRef path, std::string &error) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(path, -1, /*RequiresNullTerminator=*/false);
+  if (!file) {
+    error = file.getError().message();
+    return nullptr;
+  }
+
+  std::unique_ptr<SymbolDump> dump(new SymbolDump());
+  BinaryReader reader((*file)->getBuffer());
+  if (reader.readBytes(sizeof(Magic)) != StringRef(Magic, sizeof(Magic)) || reader.read32() != Version) {
+    error = "not a symbol dump, or written by another version";
+    return nullptr;
+  }
+  while (!reader.atEnd()) {
+    uint64_t size = reader.read64();
+    StringRef block = reader.readBytes(size);
+    if (reader.failed()) {
+      error = "truncated symbol dump";
+      return nullptr;
+    }
+    dump->blocks.push_back(block);
+  }
+  dump->buffer = std::move(*file);
+  return dump;
+}
+
+bool SymbolDump::read(size_t index, DumpedTU &tu) const {
+  BinaryReader reader(blocks[index]);
+  return readTU(reader, tu);
+}
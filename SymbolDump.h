@@ -0,0 +1,61 @@
+#ifndef OBJC_UNUSED_IMPORTS_SYMBOL_DUMP_H
+#define OBJC_UNUSED_IMPORTS_SYMBOL_DUMP_H
+
+#include "SymbolTable.h"
+
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// A TU's symbols as stored in a dump.
+struct DumpedTU {
+  std::string file;
+  int status = 0;
+  TUSymbols symbols;
+};
+
+// Writes the symbols collected from each TU, so matching can be rerun later
+// without parsing. A dump is a header followed by one size-prefixed block per
+// TU, in the order they were added. Blocks hold the TU's name table followed
+// by its other tables as name IDs.
+//
+// add() may be called from any thread. TUs are encoded by the caller's thread
+// and only the write to the file is serialized.
+class SymbolDumpWriter {
+public:
+  SymbolDumpWriter(llvm::StringRef path, std::error_code &error);
+
+  void add(llvm::StringRef file, int status, const TUSymbols &symbols);
+
+  std::error_code close();
+
+private:
+  llvm::raw_fd_ostream stream;
+  std::mutex mutex;
+};
+
+// A dump mapped into memory and split into its TUs. TUs are only decoded when
+// read, so workers can each decode the ones they match.
+class SymbolDump {
+public:
+  // Returns null and sets `error` if the file can't be read or isn't a dump.
+  static std::unique_ptr<SymbolDump> open(llvm::StringRef path, std::string &error);
+
+  size_t size() const {
+    return blocks.size();
+  }
+
+  // Returns false if the TU's block is corrupt.
+  bool read(size_t index, DumpedTU &tu) const;
+
+private:
+  std::unique_ptr<llvm::MemoryBuffer> buffer;
+  std::vector<llvm::StringRef> blocks;
+};
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef OBJC_UNUSED_IMPORTS_SYMBOL_TABLE_H
+#define OBJC_UNUSED_IMPORTS_SYMBOL_TABLE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+enum class SymbolType: uint8_t {
+  ClassDeclaration = 0,
+  Class = 1,
+  TypedefDeclaration = 2,
+  Type = 3,
+  StructDeclaration = 4,
+  Struct = 5,
+  VariableDeclaration = 6,
+  Variable = 7,
+  FunctionDeclaration = 8,
+  Function = 9,
+  EnumDeclaration = 10,
+  Enum = 11,
+  ProtocolDeclaration = 12,
+  Protocol = 13,
+  MethodDeclaration = 14,
+  Method = 15,
+  EnumConstantDeclaration = 16,
+  EnumConstant = 17,
+  PropertyDeclaration = 18,
+  Property = 19,
+  MacroDefinition = 20,
+  Macro = 21,
+  ProtocolConformanceDeclaration = 22,
+  ProtocolConformance = 23,
+  CategoryDeclaration = 24,
+  Category = 25
+};
+
+static const unsigned SymbolTypeCount = 26;
+
+inline llvm::StringRef symbolTypeToString(SymbolType type) {
+  switch (type) {
+    case SymbolType::ClassDeclaration:
+      return "ClassDeclaration";
+    case SymbolType::Class:
+      return "Class";
+    case SymbolType::TypedefDeclaration:
+      return "TypedefDeclaration";
+    case SymbolType::Type:
+      return "Type";
+    case SymbolType::StructDeclaration:
+      return "StructDeclaration";
+    case SymbolType::Struct:
+      return "Struct";
+    case SymbolType::VariableDeclaration:
+      return "VariableDeclaration";
+    case SymbolType::Variable:
+      return "Variable";
+    case SymbolType::FunctionDeclaration:
+      return "FunctionDeclaration";
+    case SymbolType::Function:
+      return "Function";
+    case SymbolType::EnumDeclaration:
+      return "EnumDeclaration";
+    case SymbolType::Enum:
+      return "Enum";
+    case SymbolType::EnumConstantDeclaration:
+      return "EnumConstantDeclaration";
+    case SymbolType::EnumConstant:
+      return "EnumConstant";
+    case SymbolType::ProtocolDeclaration:
+      return "ProtocolDeclaration";
+    case SymbolType::Protocol:
+      return "Protocol";
+    case SymbolType::MethodDeclaration:
+      return "MethodDeclaration";
+    case SymbolType::Method:
+      return "Method";
+    case SymbolType::PropertyDeclaration:
+      return "PropertyDeclaration";
+    case SymbolType::Property:
+      return "Property";
+    case SymbolType::MacroDefinition:
+      return "MacroDefinition";
+    case SymbolType::Macro:
+      return "Macro";
+    case SymbolType::ProtocolConformanceDeclaration:
+      return "ProtocolConformanceDeclaration";
+    case SymbolType::ProtocolConformance:
+      return "ProtocolConformance";
+    case SymbolType::CategoryDeclaration:
+      return "CategoryDeclaration";
+    case SymbolType::Category:
+      return "Category";
+  }
+  return "Unknown";
+}
+
+// Index of an interned name. IDs are dense, starting at 0, in interning order.
+typedef uint32_t NameID;
+
+static const NameID InvalidName = UINT32_MAX;
+
+// Interns every name seen in a TU exactly once. The characters live in a bump
+// pointer arena owned by the table, so interning allocates only when the arena
+// needs a new slab or the tables grow.
+class NameTable {
+public:
+  NameID intern(llvm::StringRef name) {
+    auto inserted = ids.insert(std::make_pair(name, NameID(names.size())));
+    if (inserted.second) {
+      names.push_back(inserted.first->getKey());
+    }
+    return inserted.first->getValue();
+  }
+
+  // Returns InvalidName if the name was never interned.
+  NameID find(llvm::StringRef name) const {
+    auto iter = ids.find(name);
+    return iter == ids.end() ? InvalidName : iter->getValue();
+  }
+
+  llvm::StringRef name(NameID id) const {
+    return names[id];
+  }
+
+  size_t size() const {
+    return names.size();
+  }
+
+  size_t getMemorySize() const {
+    return ids.getAllocator().getTotalMemory()
+         + ids.getNumBuckets() * (sizeof(void *) + sizeof(unsigned))
+         + names.capacity() * sizeof(llvm::StringRef);
+  }
+
+private:
+  llvm::StringMap<NameID, llvm::BumpPtrAllocator> ids;
+  std::vector<llvm::StringRef> names;
+};
+
+struct Symbol {
+  SymbolType type;
+  NameID name;
+
+  bool operator==(const Symbol &other) const {
+    return type == other.type && name == other.name;
+  }
+};
+
+// Receiver or declaring classes of a symbol, without duplicates. Almost always
+// one or two entries, so they are stored inline.
+typedef llvm::SmallVector<NameID, 2> ClassNameList;
+
+namespace llvm {
+  template <>
+  struct DenseMapInfo<Symbol> {
+    static inline Symbol getEmptyKey() {
+      return Symbol{static_cast<SymbolType>(UINT8_MAX), UINT32_MAX};
+    }
+
+    static inline Symbol getTombstoneKey() {
+      return Symbol{static_cast<SymbolType>(UINT8_MAX), UINT32_MAX - 1};
+    }
+
+    static unsigned getHashValue(const Symbol &symbol) {
+      // Finalizer from MurmurHash3, every bit of the kind and the ID affects
+      // the bucket.
+      uint64_t key = (static_cast<uint64_t>(symbol.type) << 32) | symbol.name;
+      key ^= key >> 33;
+      key *= 0xff51afd7ed558ccdULL;
+      key ^= key >> 33;
+      key *= 0xc4ceb9fe1a85ec53ULL;
+      key ^= key >> 33;
+      return static_cast<unsigned>(key);
+    }
+
+    static bool isEqual(const Symbol &lhs, const Symbol &rhs) {
+      return lhs == rhs;
+    }
+  };
+}
+
+typedef llvm::DenseMap<Symbol, ClassNameList> SymbolSet;
+
+typedef llvm::DenseMap<NameID, NameID> SuperClassMap;
+
+// Everything a module declares, in its own name table so that it can be shared
+// by every TU that imports the module.
+struct ModuleExports {
+  NameTable names;
+  SymbolSet symbols;
+};
+
+// What matching needs from a TU, whether it was just parsed or loaded from a
+// dump. Every name (files, modules, symbols, classes) is interned in `names`,
+// the other tables only hold IDs.
+struct TUSymbols {
+  NameTable names;
+  NameID mainFile = InvalidName;
+  llvm::DenseMap<NameID, SymbolSet> symbolsForFile;
+  llvm::DenseMap<NameID, unsigned int> lineNumbers;
+  llvm::DenseSet<NameID> modulesImported;
+  SuperClassMap superClass;
+  // Modules whose symbols come from the process-wide export index instead of
+  // symbolsForFile, by interned top-level module name.
+  std::vector<std::pair<NameID, std::shared_ptr<const ModuleExports>>> indexedModules;
+  // Headers and top-level modules declaring something the main file
+  // references, matched by declaration rather than by name.
+  llvm::DenseSet<NameID> usedImports;
+};
+
+inline void insertSymbol(SymbolSet& set, Symbol symbol, NameID className = InvalidName) {
+  ClassNameList &classNames = set[symbol];
+  if (className == InvalidName) {
+    return;
+  }
+  for (NameID existing : classNames) {
+    if (existing == className) {
+      return;
+    }
+  }
+  classNames.push_back(className);
+}
+
+#endif
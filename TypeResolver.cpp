@@ -0,0 +1,123 @@
+#include "TypeResolver.h"
+
+#include "clang/AST/DeclObjC.h"
+
+using namespace clang;
+using namespace llvm;
+
+NameID TypeResolver::nameOf(const NamedDecl *declaration) {
+  auto inserted = declarationNames.insert(std::make_pair(declaration, InvalidName));
+  if (inserted.second) {
+    StringRef name = declaration->getName();
+    if (!name.empty()) {
+      inserted.first->second = names.intern(name);
+    }
+  }
+  return inserted.first->second;
+}
+
+void TypeResolver::add(const NamedDecl *declaration, SmallVectorImpl<NameID> &result) {
+  NameID name = nameOf(declaration);
+  if (name != InvalidName) {
+    result.push_back(name);
+  }
+}
+
+void TypeResolver::typeDeclarations(QualType type, SmallVectorImpl<const NamedDecl *> &result) {
+  const Type *current = type.getTypePtrOrNull();
+  while (current) {
+    if (auto *typedefType = dyn_cast<TypedefType>(current)) {
+      result.push_back(typedefType->getDecl());
+      return;
+    }
+    if (auto *parenType = dyn_cast<ParenType>(current)) {
+      current = parenType->getInnerType().getTypePtrOrNull();
+    } else if (auto *attributedType = dyn_cast<AttributedType>(current)) {
+      current = attributedType->getModifiedType().getTypePtrOrNull();
+    } else if (auto *elaboratedType = dyn_cast<ElaboratedType>(current)) {
+      current = elaboratedType->getNamedType().getTypePtrOrNull();
+    } else if (auto *adjustedType = dyn_cast<AdjustedType>(current)) {
+      current = adjustedType->getOriginalType().getTypePtrOrNull();
+    } else if (auto *substitutedType = dyn_cast<SubstTemplateTypeParmType>(current)) {
+      current = substitutedType->getReplacementType().getTypePtrOrNull();
+    } else if (auto *pointerType = dyn_cast<PointerType>(current)) {
+      current = pointerType->getPointeeType().getTypePtrOrNull();
+    } else if (auto *referenceType = dyn_cast<ReferenceType>(current)) {
+      current = referenceType->getPointeeType().getTypePtrOrNull();
+    } else if (auto *blockType = dyn_cast<BlockPointerType>(current)) {
+      current = blockType->getPointeeType().getTypePtrOrNull();
+    } else if (auto *arrayType = dyn_cast<ArrayType>(current)) {
+      current = arrayType->getElementType().getTypePtrOrNull();
+    } else if (auto *functionType = dyn_cast<FunctionType>(current)) {
+      if (auto *prototype = dyn_cast<FunctionProtoType>(functionType)) {
+        for (QualType parameter : prototype->getParamTypes()) {
+          typeDeclarations(parameter, result);
+        }
+      }
+      current = functionType->getReturnType().getTypePtrOrNull();
+    } else if (auto *pointerType = dyn_cast<ObjCObjectPointerType>(current)) {
+      current = pointerType->getObjectType();
+    } else if (auto *objectType = dyn_cast<ObjCObjectType>(current)) {
+      if (ObjCInterfaceDecl *interface = objectType->getInterface()) {
+        result.push_back(interface);
+      }
+      for (ObjCProtocolDecl *protocol : objectType->quals()) {
+        result.push_back(protocol);
+      }
+      for (QualType typeArgument : objectType->getTypeArgsAsWritten()) {
+        typeDeclarations(typeArgument, result);
+      }
+      return;
+    } else if (auto *tagType = dyn_cast<TagType>(current)) {
+      result.push_back(tagType->getDecl());
+      return;
+    } else {
+      return;
+    }
+  }
+}
+
+void TypeResolver::receiverNames(QualType type, SmallVectorImpl<NameID> &result) {
+  if (type.isNull()) {
+    return;
+  }
+  const ObjCObjectType *objectType = nullptr;
+  if (auto *pointerType = type->getAs<ObjCObjectPointerType>()) {
+    objectType = pointerType->getObjectType();
+  } else {
+    objectType = type->getAs<ObjCObjectType>();
+  }
+  if (!objectType) {
+    return;
+  }
+
+  if (ObjCInterfaceDecl *interface = objectType->getInterface()) {
+    add(interface, result);
+  } else if (objectType->getNumProtocols() == 0) {
+    if (objectType->isObjCId()) {
+      if (idName == InvalidName) {
+        idName = names.intern("id");
+      }
+      result.push_back(idName);
+    } else if (objectType->isObjCClass()) {
+      if (className == InvalidName) {
+        className = names.intern("Class");
+      }
+      result.push_back(className);
+    }
+  }
+  for (ObjCProtocolDecl *protocol : objectType->quals()) {
+    add(protocol, result);
+  }
+}
+
+void TypeResolver::protocolNames(QualType type, SmallVectorImpl<NameID> &result) {
+  if (type.isNull()) {
+    return;
+  }
+  if (auto *pointerType = type->getAs<ObjCObjectPointerType>()) {
+    for (ObjCProtocolDecl *protocol : pointerType->quals()) {
+      add(protocol, result);
+    }
+  }
+}
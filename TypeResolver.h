@@ -0,0 +1,45 @@
+#ifndef OBJC_UNUSED_IMPORTS_TYPE_RESOLVER_H
+#define OBJC_UNUSED_IMPORTS_TYPE_RESOLVER_H
+
+#include "SymbolTable.h"
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/Type.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+
+// Finds the declarations a type refers to by walking its structure, without
+// printing it. Members are still matched by the name of their class, so
+// receivers come out as IDs of the TU's name table, interned once per
+// declaration.
+class TypeResolver {
+public:
+  explicit TypeResolver(NameTable &names) : names(names) {}
+
+  // The typedefs, interfaces, protocols and tags a type is spelled with, which
+  // the main file uses by identity. Pointers, blocks, function types and type arguments are
+  // walked into. A typedef ends the walk, its declaration is all the spelling
+  // needs.
+  void typeDeclarations(clang::QualType type, llvm::SmallVectorImpl<const clang::NamedDecl *> &result);
+
+  // The classes a message or property on a value of this type is looked up
+  // in, with typedefs seen through: its interface, `id` or `Class` when
+  // unqualified, and the protocols it is qualified with.
+  void receiverNames(clang::QualType type, llvm::SmallVectorImpl<NameID> &result);
+
+  // The protocols of a qualified id or Class.
+  void protocolNames(clang::QualType type, llvm::SmallVectorImpl<NameID> &result);
+
+  // InvalidName for anonymous declarations.
+  NameID nameOf(const clang::NamedDecl *declaration);
+
+private:
+  NameTable &names;
+  llvm::DenseMap<const clang::NamedDecl *, NameID> declarationNames;
+  NameID idName = InvalidName;
+  NameID className = InvalidName;
+
+  void add(const clang::NamedDecl *declaration, llvm::SmallVectorImpl<NameID> &result);
+};
+
+#endif
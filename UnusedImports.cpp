@@ -2,13 +2,42 @@
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendAction.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Serialization/ASTReader.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Tooling.h"
+#include "AllocationCounter.h"
+#include "FileSystemCache.h"
+#include "HeaderCommands.h"
+#include "ImportFixes.h"
+#include "ImportIndex.h"
+#include "ImportScanner.h"
+#include "Matching.h"
+#include "ModuleIndex.h"
+#include "PreambleCache.h"
+#include "ResultCache.h"
+#include "ResultEmitter.h"
+#include "Schedule.h"
+#include "ShardResults.h"
+#include "Stats.h"
+#include "SymbolDump.h"
+#include "SymbolTable.h"
+#include "TypeResolver.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
 
-#include <unordered_set>
-#include <unordered_map>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <thread>
+#include <vector>
 
 using namespace llvm;
 using namespace clang;
@@ -25,297 +54,643 @@ static cl::extrahelp CommonHelp(CommonOptionsParser::HelpMessage);
 
 // A help message for this specific tool can be added afterwards.
 static cl::extrahelp MoreHelp("\nMore help text...\n");
+
+// The options CommonOptionsParser would register. The tool declares them
+// itself because CommonOptionsParser doesn't load a compilation database when
+// it is given no source files, which `--all -p <build>` needs.
+static cl::opt<std::string> BuildPath("p",
+  cl::desc("Build path"),
+  cl::Optional, cl::cat(toolCategory));
+static cl::list<std::string> SourcePaths(cl::Positional,
+  cl::desc("<source0> [... <sourceN>]"),
+  cl::ZeroOrMore, cl::cat(toolCategory));
+static cl::list<std::string> ArgsAfter("extra-arg",
+  cl::desc("Additional argument to append to the compiler command line"),
+  cl::cat(toolCategory));
+static cl::list<std::string> ArgsBefore("extra-arg-before",
+  cl::desc("Additional argument to prepend to the compiler command line"),
+  cl::cat(toolCategory));
 static cl::opt<bool> DebugPrint("debug-print");
+static cl::opt<bool> AnalyzeAll("all",
+  cl::desc("Analyze every translation unit in the compilation database"),
+  cl::cat(toolCategory));
+static cl::opt<unsigned> Jobs("j",
+  cl::desc("Number of translation units to analyze in parallel (default: number of cores)"),
+  cl::init(0), cl::cat(toolCategory));
+static cl::opt<bool> FullTraversal("full-traversal",
+  cl::desc("Traverse the whole translation unit, including bodies in headers that can't affect the result"),
+  cl::cat(toolCategory), cl::Hidden);
+// Only objc-unused-imports-alloc-stats counts allocations, see
+// AllocationCounter.h.
+#ifdef OBJC_UNUSED_IMPORTS_COUNT_ALLOCATIONS
+static cl::opt<bool> AllocStats("alloc-stats",
+  cl::desc("Report heap allocations made while collecting symbols"),
+  cl::cat(toolCategory));
+#else
+static const bool AllocStats = false;
+#endif
+static cl::opt<std::string> ResultCachePath("cache",
+  cl::desc("Skip translation units that haven't changed since their results were stored in this file"),
+  cl::value_desc("path"), cl::cat(toolCategory));
+static cl::opt<std::string> DumpSymbolsPath("dump-symbols",
+  cl::desc("Write the symbols collected from every translation unit to this file"),
+  cl::value_desc("path"), cl::cat(toolCategory));
+static cl::list<std::string> RematchPaths("rematch",
+  cl::desc("Match the symbols in these dumps instead of parsing anything"),
+  cl::value_desc("dump"), cl::CommaSeparated, cl::cat(toolCategory));
+static cl::opt<bool> PrintStats("print-stats",
+  cl::desc("Print counters and phase times for each translation unit and for the whole run"),
+  cl::cat(toolCategory));
+static cl::opt<std::string> TimeTracePath("time-trace",
+  cl::desc("Write a Chrome trace of every translation unit's phases to this file"),
+  cl::value_desc("path"), cl::cat(toolCategory));
+static cl::opt<bool> Serve("serve",
+  cl::desc("Keep running and analyze the files requested on stdin, one 'analyze <file>' per line"),
+  cl::cat(toolCategory));
+static cl::opt<bool> SharePreambles("share-preambles",
+  cl::desc("Precompile import blocks shared by several translation units and reuse them"),
+  cl::cat(toolCategory));
+static cl::opt<bool> HeaderSubjects("headers",
+  cl::desc("Analyze headers and suggest forward declarations for imports they only use through pointers"),
+  cl::cat(toolCategory));
+static cl::opt<bool> Fix("fix",
+  cl::desc("Remove the lines of unused imports once every translation unit is analyzed"),
+  cl::cat(toolCategory));
+static cl::opt<std::string> ExportFixesPath("export-fixes",
+  cl::desc("Write the removals of unused imports to this file, as YAML for clang-apply-replacements"),
+  cl::value_desc("path"), cl::cat(toolCategory));
+static cl::opt<OutputFormat> Format("output-format",
+  cl::desc("How results are reported"),
+  cl::values(clEnumValN(OutputFormat::Text, "text", "Warnings in file order once every translation unit is done (default)"),
+             clEnumValN(OutputFormat::JSONLines, "jsonl", "A JSON record per finding and per translation unit, as each one finishes"),
+             clEnumValN(OutputFormat::SARIF, "sarif", "A SARIF 2.1.0 log, streamed as translation units finish")),
+  cl::init(OutputFormat::Text), cl::cat(toolCategory));
+static cl::opt<bool> ImportCosts("import-cost",
+  cl::desc("Measure what each unused import adds to the build and rank the imports by it"),
+  cl::cat(toolCategory));
+static cl::opt<std::string> ShardSpec("shard",
+  cl::desc("Only analyze shard i of n of the translation units, 1 <= i <= n"),
+  cl::value_desc("i/n"), cl::cat(toolCategory));
+static cl::opt<std::string> ShardOutputPath("shard-output",
+  cl::desc("Write the results of the shard to this file for --merge-shards"),
+  cl::value_desc("path"), cl::cat(toolCategory));
+static cl::list<std::string> MergeShardPaths("merge-shards",
+  cl::desc("Report the results in these shard files as a single run would, instead of parsing anything"),
+  cl::value_desc("path"), cl::CommaSeparated, cl::cat(toolCategory));
+static cl::opt<bool> Prefilter("prefilter",
+  cl::desc("Scan main files for imports before parsing them and skip the ones without any"),
+  cl::cat(toolCategory));
+static cl::opt<bool> FileCache("file-cache",
+  cl::desc("Share the stats and contents of the files every translation unit reads, kept in memory until the run ends"),
+  cl::cat(toolCategory));
+static cl::opt<std::string> ScheduleHistoryPath("schedule-history",
+  cl::desc("Record how long each translation unit took in this file and start the slowest ones first next time"),
+  cl::value_desc("path"), cl::cat(toolCategory));
+static cl::opt<std::string> WriteIndexPath("write-index",
+  cl::desc("Write every import of every translation unit, with its line and whether it is used, to this index"),
+  cl::value_desc("path"), cl::cat(toolCategory));
+static cl::list<std::string> QueryIndexPaths("query-index",
+  cl::desc("Answer --query from these indexes instead of parsing anything, without --query list every import"),
+  cl::value_desc("index"), cl::CommaSeparated, cl::cat(toolCategory));
+static cl::list<std::string> QueryImports("query",
+  cl::desc("Headers or modules to list the importing translation units of, a file name matches any path ending in it"),
+  cl::value_desc("import"), cl::CommaSeparated, cl::cat(toolCategory));
+
+// Machine-readable formats own stdout, everything else goes to stderr then.
+llvm::raw_ostream &textOutput() {
+  return Format == OutputFormat::Text ? llvm::outs() : llvm::errs();
+}
 
-enum class SymbolType: std::size_t {
-  ClassDeclaration = 0,
-  Class = 1,
-  TypedefDeclaration = 2,
-  Type = 3,
-  StructDeclaration = 4,
-  Struct = 5,
-  VariableDeclaration = 6,
-  Variable = 7,
-  FunctionDeclaration = 8,
-  Function = 9,
-  EnumDeclaration = 10,
-  Enum = 11,
-  ProtocolDeclaration = 12,
-  Protocol = 13,
-  MethodDeclaration = 14,
-  Method = 15,
-  EnumConstantDeclaration = 16,
-  EnumConstant = 17,
-  PropertyDeclaration = 18,
-  Property = 19,
-  MacroDefinition = 20,
-  Macro = 21,
-  ProtocolConformanceDeclaration = 22,
-  ProtocolConformance = 23,
-  CategoryDeclaration = 24,
-  Category = 25
+// Everything collected while analyzing a single translation unit. Each TU gets
+// its own context, so TUs can be analyzed in parallel.
+struct TUContext : TUSymbols {
+  // Selector::getAsString builds a new string each time, intern each selector once.
+  llvm::DenseMap<void *, NameID> selectorNames;
+  // Heap allocations made by the AST traversal, for --alloc-stats.
+  uint64_t collectionAllocations = 0;
+  TUStats stats;
+  // Errors the visitors ran into, printed with the TU's results so that those
+  // of parallel workers don't interleave.
+  std::string diagnostics;
+  // Phases are only timed for --print-stats and --time-trace.
+  bool timePhases = false;
+  TimeTrace *timeTrace = nullptr;
+  // Every file the TU read, for --cache.
+  bool recordDependencies = false;
+  std::vector<FileStamp> dependencies;
+  // Exports of the modules earlier TUs have seen, null with --full-traversal.
+  ModuleExportIndex *moduleIndex = nullptr;
+  // The cost of every header the main file imports, for --import-cost.
+  bool measureImportCosts = false;
+  llvm::DenseMap<NameID, ImportCost> importCosts;
+  // Set when the main file is a header, see HeaderUseVisitor.
+  bool headerSubject = false;
+  HeaderImportUses headerUses;
+  // Every import of the main file has a line, even one that declares nothing,
+  // for --write-index.
+  bool recordAllImports = false;
+  // Canonical declarations of the variables, functions, enum constants and
+  // types the main file references, attributed to imports after traversal.
+  llvm::DenseSet<const Decl *> usedDeclarations;
 };
 
-static std::string symbolTypeToString(const SymbolType& type) {
-  switch (type) {
-    case SymbolType::ClassDeclaration:
-      return "ClassDeclaration";
-    case SymbolType::Class:
-      return "Class";
-    case SymbolType::TypedefDeclaration:
-      return "TypedefDeclaration";
-    case SymbolType::Type:
-      return "Type";
-    case SymbolType::StructDeclaration:
-      return "StructDeclaration";
-    case SymbolType::Struct:
-      return "Struct";
-    case SymbolType::VariableDeclaration:
-      return "VariableDeclaration";
-    case SymbolType::Variable:
-      return "Variable";
-    case SymbolType::FunctionDeclaration:
-      return "FunctionDeclaration";
-    case SymbolType::Function:
-      return "Function";
-    case SymbolType::EnumDeclaration:
-      return "EnumDeclaration";
-    case SymbolType::Enum:
-      return "Enum";
-    case SymbolType::EnumConstantDeclaration:
-      return "EnumConstantDeclaration";
-    case SymbolType::EnumConstant:
-      return "EnumConstant";
-    case SymbolType::ProtocolDeclaration:
-      return "ProtocolDeclaration";
-    case SymbolType::Protocol:
-      return "Protocol";
-    case SymbolType::MethodDeclaration:
-      return "MethodDeclaration";
-    case SymbolType::Method:
-      return "Method";
-    case SymbolType::PropertyDeclaration:
-      return "PropertyDeclaration";
-    case SymbolType::Property:
-      return "Property";
-    case SymbolType::MacroDefinition:
-      return "MacroDefinition";
-    case SymbolType::Macro:
-      return "Macro";
-    case SymbolType::ProtocolConformanceDeclaration:
-      return "ProtocolConformanceDeclaration";
-    case SymbolType::ProtocolConformance:
-      return "ProtocolConformance";
-    case SymbolType::CategoryDeclaration:
-      return "CategoryDeclaration";
-    case SymbolType::Category:
-      return "Category";
-  }
+TUStats *phaseStats(TUContext &tuContext) {
+  return tuContext.timePhases ? &tuContext.stats : nullptr;
 }
 
-namespace std {
-  template <>
-  struct hash<SymbolType>
-  {
-    std::size_t operator()(const SymbolType& type) const
-    {
-      return static_cast<std::size_t>(type);
-    }
-  };
+void insertSymbolForFile(TUContext& tuContext, NameID fileName, Symbol symbol, NameID className) {
+  tuContext.stats.symbolsInserted[static_cast<size_t>(symbol.type)]++;
+  insertSymbol(tuContext.symbolsForFile[fileName], symbol, className);
 }
 
-struct Symbol {
-  SymbolType type;
-  std::string value;
-  std::unordered_set<std::string> *classNames;
+// What a file is to the main file.
+struct FileInfo {
+  enum Kind : uint8_t {
+    Irrelevant,
+    Main,
+    IncludedByMain,
+    Module
+  };
+
+  Kind kind = Irrelevant;
+  // Interned file name, or the top-level module name for Module.
+  NameID name = InvalidName;
+};
 
-  Symbol(SymbolType type, std::string value) {
-    this->type = type;
-    this->value = value;
-    this->classNames = nullptr;
+// Classifies each FileID once per TU. Every symbol in a file gets the same
+// answer, so the include location, module import location and file entry are
+// only looked up the first time a FileID is seen.
+// When the TU loads a shared preamble, the imports at the top of the main file
+// come from the preamble's copy of the file that built it. Those bytes are the
+// same as the main file's, so that copy counts as the main file, line numbers
+// included.
+class FileClassifier {
+public:
+  FileClassifier(const SourceManager &sourceManager, TUContext &tuContext)
+    : sourceManager(sourceManager), tuContext(tuContext) {}
+
+  FileInfo classify(FileID fileID) {
+    auto iter = cache.find(fileID);
+    if (iter != cache.end()) {
+      tuContext.stats.fileClassifierHits++;
+      return iter->second;
+    }
+    tuContext.stats.fileClassifierMisses++;
+    FileInfo info = compute(fileID);
+    cache.insert(std::make_pair(fileID, info));
+    return info;
   }
 
-  bool operator==(const Symbol &other) const {
-   return type == other.type && value == other.value;
+  // Macro locations belong to no file.
+  FileInfo classify(SourceLocation location) {
+    if (location.isInvalid() || !location.isFileID()) {
+      return FileInfo();
+    }
+    return classify(sourceManager.getFileID(location));
   }
-};
 
-namespace std {
-  template <>
-  struct hash<Symbol>
-  {
-    std::size_t operator()(const Symbol& symbol) const
-    {
-      using std::size_t;
-      using std::hash;
-      using std::string;
+  // The import of the main file that brought a file in, directly or through
+  // other headers: the header's name or the top-level module's. InvalidName
+  // for the main file and whatever the compiler adds on its own.
+  NameID importOf(FileID fileID) {
+    auto iter = imports.find(fileID);
+    if (iter != imports.end()) {
+      return iter->second;
+    }
+    NameID import = InvalidName;
+    FileInfo info = classify(fileID);
+    if (info.kind == FileInfo::IncludedByMain || info.kind == FileInfo::Module) {
+      import = info.name;
+    } else if (info.kind == FileInfo::Irrelevant) {
+      SourceLocation includeLocation = sourceManager.getIncludeLoc(fileID);
+      if (includeLocation.isValid()) {
+        import = importOf(sourceManager.getFileID(includeLocation));
+      }
+    }
+    imports.insert(std::make_pair(fileID, import));
+    return import;
+  }
 
-      return (hash<string>()(symbol.value) << 8) | hash<SymbolType>()(symbol.type);
+  NameID importOf(SourceLocation location) {
+    location = sourceManager.getFileLoc(location);
+    return location.isValid() ? importOf(sourceManager.getFileID(location)) : InvalidName;
+  }
+
+private:
+  const SourceManager &sourceManager;
+  TUContext &tuContext;
+  llvm::DenseMap<FileID, FileInfo> cache;
+  llvm::DenseMap<FileID, NameID> imports;
+
+  FileInfo compute(FileID fileID) {
+    FileInfo info;
+    FileID mainFileID = sourceManager.getMainFileID();
+    if (fileID.isInvalid() || mainFileID.isInvalid()) {
+      return info;
+    }
+
+    if (isMainFile(fileID)) {
+      info.name = fileName(mainFileID);
+      if (info.name != InvalidName) {
+        info.kind = FileInfo::Main;
+      }
+      return info;
     }
-  };
-}
 
-static std::unordered_map<std::string, std::unordered_set<Symbol>> symbolsForFile;
-static std::unordered_map<std::string, unsigned int> lineNumbers;
-static std::unordered_set<std::string> modulesImported;
-static std::unordered_map<std::string, std::string> superClass;
-static std::unordered_map<std::string, std::unordered_set<std::string>> macroDefinitions;
-static std::unordered_map<std::string, std::unordered_set<std::string>> macroUsages;
+    std::pair<SourceLocation, StringRef> moduleInfo = sourceManager.getModuleImportLoc(sourceManager.getLocForStartOfFile(fileID));
+    if (moduleInfo.first.isValid()) {
+      info.kind = FileInfo::Module;
+      info.name = tuContext.names.intern(moduleInfo.second);
+      return info;
+    }
 
-void insertSymbol(std::unordered_set<Symbol>& set, Symbol symbol, std::string className) {
-  if (className == "") {
-    set.insert(symbol);
-  } else {
-    auto iter = set.find(symbol);
-    if (iter == set.end()) {
-      auto classNames = new std::unordered_set<std::string>();
-      classNames->insert(className);
-      symbol.classNames = classNames;
-      set.insert(symbol);
-    } else {
-      iter->classNames->insert(className);
+    SourceLocation includeLocation = sourceManager.getIncludeLoc(fileID);
+    if (includeLocation.isValid() && includeLocation.isFileID() && isMainFile(sourceManager.getFileID(includeLocation))) {
+      info.name = fileName(fileID);
+      if (info.name != InvalidName) {
+        info.kind = FileInfo::IncludedByMain;
+        // A header included twice keeps the line of its first import.
+        tuContext.lineNumbers.insert(std::make_pair(info.name, sourceManager.getSpellingLineNumber(includeLocation)));
+      }
     }
+    return info;
   }
-}
 
-void insertSymbolForFile(std::string fileName, Symbol& symbol, std::string className) {
-  auto iter = symbolsForFile.find(fileName);
-  if (iter == symbolsForFile.end())
-  {
-    auto symbolSet = std::unordered_set<Symbol>();
-    // Insert symbol before inserting to symbolsForFile, because a copy is made.
-    insertSymbol(symbolSet, symbol, className);
-    symbolsForFile.insert(std::pair<std::string, std::unordered_set<Symbol>>(fileName, symbolSet));
-  } else {
-    insertSymbol(iter->second, symbol, className);
+  bool isMainFile(FileID fileID) const {
+    if (fileID == sourceManager.getMainFileID()) {
+      return true;
+    }
+    FileID preambleFileID = sourceManager.getPreambleFileID();
+    return preambleFileID.isValid() && fileID == preambleFileID;
   }
-}
 
-bool addSymbolIfModule(const SourceManager& sourceManager, FullSourceLoc& fullLocation, Symbol& symbol, std::string className = "") {
-  std::pair<SourceLocation, StringRef> moduleInfo = sourceManager.getModuleImportLoc(fullLocation);
-  if (moduleInfo.first.isValid()) {
-    insertSymbolForFile(moduleInfo.second.str(), symbol, className);
-    return true;
+  NameID fileName(FileID fileID) {
+    const FileEntry *fileEntry = sourceManager.getFileEntryForID(fileID);
+    if (!fileEntry || !fileEntry->isValid() || fileEntry->getName().empty()) {
+      return InvalidName;
+    }
+    return tuContext.names.intern(fileEntry->getName());
+  }
+};
+
+bool addSymbolIfModule(TUContext& tuContext, const FileInfo& file, Symbol symbol, NameID className = InvalidName) {
+  if (file.kind != FileInfo::Module) {
+    return false;
   }
-  return false;
+  insertSymbolForFile(tuContext, file.name, symbol, className);
+  return true;
 }
 
-bool addSymbolIfIncludedByMain(const SourceManager& sourceManager, ASTContext *context, FullSourceLoc& fullLocation, Symbol& symbol, std::string className = "") {
-  SourceLocation includeLocation = sourceManager.getIncludeLoc(fullLocation.getFileID());
-  if (includeLocation.isValid()) {
-    FullSourceLoc fullIncludeLocation = context->getFullLoc(includeLocation);
-    if (fullIncludeLocation.isValid()) {
-      FileID includedFileID = fullIncludeLocation.getFileID();
-      if (includedFileID.isValid()) {
-        FileID mainFileID = sourceManager.getMainFileID();
-        if (mainFileID.isValid() && includedFileID == mainFileID) {
-          const FileEntry *fileEntry = fullLocation.getFileEntry();
-          if (fileEntry && fileEntry->isValid()) {
-            StringRef filenameRef = fileEntry->getName();
-            if (!filenameRef.empty()) {
-              std::string filename = filenameRef.str();
-              if (lineNumbers.find(filename) == lineNumbers.end()) {
-                lineNumbers.insert(std::pair<std::string, unsigned int>(filename, fullIncludeLocation.getLineNumber()));
-              }
-              insertSymbolForFile(filename, symbol, className);
-              return true;
-            }
-          }
-        }
-      }
-    }
+bool addSymbolIfIncludedByMain(TUContext& tuContext, const FileInfo& file, Symbol symbol, NameID className = InvalidName) {
+  if (file.kind != FileInfo::IncludedByMain) {
+    return false;
   }
-  return false;
+  insertSymbolForFile(tuContext, file.name, symbol, className);
+  return true;
 }
 
-void addSymbolIfMain(const SourceManager& sourceManager, FullSourceLoc& fullLocation, Symbol& symbol, std::string className = "") {
-  FileID declFileID = fullLocation.getFileID();
-  FileID mainFileID = sourceManager.getMainFileID();
-  if (declFileID.isValid() && mainFileID.isValid() && declFileID == mainFileID) {
-    const FileEntry *fileEntry = fullLocation.getFileEntry();
-    if (fileEntry && fileEntry->isValid()) {
-      StringRef filename = fileEntry->getName();
-      if (!filename.empty()) {
-        insertSymbolForFile(filename.str(), symbol, className);
-      }
-    }
+void addSymbolIfMain(TUContext& tuContext, const FileInfo& file, Symbol symbol, NameID className = InvalidName) {
+  if (file.kind == FileInfo::Main) {
+    insertSymbolForFile(tuContext, file.name, symbol, className);
   }
 }
 
 class PPCallbacksTracker : public clang::PPCallbacks {
 public:
-  PPCallbacksTracker(clang::Preprocessor &PP, ASTContext *context) : preprocessor(PP), context(context) {}
+  PPCallbacksTracker(clang::Preprocessor &PP, TUContext &tuContext, FileClassifier &classifier)
+    : preprocessor(PP), tuContext(tuContext), classifier(classifier) {}
 
   void MacroDefined(const clang::Token &macroNameToken,
                     const clang::MacroDirective *macroDirective) {
+    tuContext.stats.macroDefinitions++;
+    PhaseTimer timer(phaseStats(tuContext), Phase::PreprocessorCallbacks);
     if(macroDirective->isFromPCH()) {
       return;
     }
 
-    FullSourceLoc fullLocation = context->getFullLoc(macroDirective->getLocation());
-    if (!fullLocation.isValid()) {
+    FileInfo file = classifier.classify(macroDirective->getLocation());
+    if (file.kind != FileInfo::IncludedByMain) {
       return;
     }
 
-    Symbol symbol = Symbol(SymbolType::MacroDefinition, preprocessor.getSpelling(macroNameToken));
-
-    const SourceManager& sourceManager = preprocessor.getSourceManager();
-    if (addSymbolIfIncludedByMain(sourceManager, context, fullLocation, symbol)) {
-      return;
-    }
+    Symbol symbol = {SymbolType::MacroDefinition, tuContext.names.intern(macroNameToken.getIdentifierInfo()->getName())};
+    addSymbolIfIncludedByMain(tuContext, file, symbol);
   }
   void MacroExpands(const clang::Token &macroNameToken,
                     const clang::MacroDefinition &macroDefinition,
                     clang::SourceRange range,
                     const clang::MacroArgs *args) {
-    FullSourceLoc fullLocation = context->getFullLoc(range.getBegin());
-    if (!fullLocation.isValid()) {
+    tuContext.stats.macroExpansions++;
+    PhaseTimer timer(phaseStats(tuContext), Phase::PreprocessorCallbacks);
+    if (range.getBegin().isInvalid()) {
       return;
     }
 
-    std::string name = preprocessor.getSpelling(macroNameToken);
-    Symbol symbol = Symbol(SymbolType::Macro, name);
+    // The macros modules define are collected with the rest of their exports,
+    // see ModuleExportCollector.
+    NameID name = tuContext.names.intern(macroNameToken.getIdentifierInfo()->getName());
+    Symbol symbol = {SymbolType::Macro, name};
+    addSymbolIfMain(tuContext, classifier.classify(range.getBegin()), symbol);
+    useMacroIfHeaderSubject(range.getBegin(), macroDefinition);
+  }
+
+  void Ifdef(clang::SourceLocation location, const clang::Token &macroNameToken,
+             const clang::MacroDefinition &macroDefinition) {
+    useMacroIfHeaderSubject(location, macroDefinition);
+  }
+
+  void Ifndef(clang::SourceLocation location, const clang::Token &macroNameToken,
+              const clang::MacroDefinition &macroDefinition) {
+    useMacroIfHeaderSubject(location, macroDefinition);
+  }
 
-    const SourceManager& sourceManager = preprocessor.getSourceManager();
-    addSymbolIfMain(sourceManager, fullLocation, symbol);
+  void Defined(const clang::Token &macroNameToken, const clang::MacroDefinition &macroDefinition,
+               clang::SourceRange range) {
+    useMacroIfHeaderSubject(range.getBegin(), macroDefinition);
+  }
 
-    // Modules are precompiled, so we need to check for macro definitions at time of use
-    for (clang::ModuleMacro* moduleMacro : macroDefinition.getModuleMacros()) {
-      if (moduleMacro) {
-        if (clang::Module *module = moduleMacro->getOwningModule()) {
-          Symbol moduleSymbol = Symbol(SymbolType::MacroDefinition, name);
-          insertSymbolForFile(module->getTopLevelModule()->Name, moduleSymbol, "");
+  // Attributes every file entered while an import of the main file is open to
+  // that import.
+  void FileChanged(clang::SourceLocation location, FileChangeReason reason,
+                   clang::SrcMgr::CharacteristicKind fileType, clang::FileID previousFileID) {
+    // A header subject reports every import, and the index records every
+    // import, including those that declare nothing.
+    if ((tuContext.headerSubject || tuContext.recordAllImports) && reason == EnterFile) {
+      classifier.classify(location);
+    }
+    if (!tuContext.measureImportCosts) {
+      return;
+    }
+    const SourceManager &sourceManager = preprocessor.getSourceManager();
+    if (reason == EnterFile) {
+      FileID fileID = sourceManager.getFileID(location);
+      if (openImport == InvalidName) {
+        FileInfo file = classifier.classify(fileID);
+        if (file.kind != FileInfo::IncludedByMain) {
+          return;
         }
+        openImport = file.name;
+        importBegin = std::chrono::steady_clock::now();
+      }
+      importDepth++;
+      // A file entered again, without include guards or through another
+      // import, was already counted by the import that read it first.
+      const FileEntry *fileEntry = sourceManager.getFileEntryForID(fileID);
+      if (!fileEntry || !filesRead.insert(fileEntry).second) {
+        return;
       }
+      ImportCost &cost = tuContext.importCosts[openImport];
+      cost.bytes += fileEntry->getSize();
+      cost.files++;
+      enteredFiles.push_back(std::make_pair(openImport, fileID));
+    } else if (reason == ExitFile && openImport != InvalidName && --importDepth == 0) {
+      tuContext.importCosts[openImport].seconds +=
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - importBegin).count();
+      openImport = InvalidName;
+    }
+  }
+
+  // Tokens are counted once the main file is done, so lexing them again
+  // doesn't add to the imports' times.
+  void EndOfMainFile() {
+    for (auto &entered : enteredFiles) {
+      tuContext.importCosts[entered.first].tokens += countTokens(entered.second);
     }
+    enteredFiles.clear();
   }
 private:
   clang::Preprocessor &preprocessor;
-  ASTContext *context;
+  TUContext &tuContext;
+  FileClassifier &classifier;
+  NameID openImport = InvalidName;
+  unsigned importDepth = 0;
+  TimePoint importBegin;
+  llvm::DenseSet<const FileEntry *> filesRead;
+  // The first entry of each file, so every file is counted once per TU.
+  std::vector<std::pair<NameID, FileID>> enteredFiles;
+
+  // A header that checks or expands a macro needs the import defining it.
+  void useMacroIfHeaderSubject(clang::SourceLocation location, const clang::MacroDefinition &macroDefinition) {
+    if (!tuContext.headerSubject || classifier.classify(location).kind != FileInfo::Main) {
+      return;
+    }
+    const MacroInfo *macroInfo = macroDefinition.getMacroInfo();
+    if (!macroInfo) {
+      return;
+    }
+    NameID import = classifier.importOf(macroInfo->getDefinitionLoc());
+    if (import != InvalidName) {
+      tuContext.headerUses[import].needsDefinition = true;
+    }
+  }
+
+  // Raw tokens in a file, directives and skipped blocks included, as a
+  // measure of how much the preprocessor had to lex.
+  uint64_t countTokens(FileID fileID) {
+    const SourceManager &sourceManager = preprocessor.getSourceManager();
+    bool invalid = false;
+    const llvm::MemoryBuffer *buffer = sourceManager.getBuffer(fileID, &invalid);
+    if (invalid) {
+      return 0;
+    }
+    Lexer lexer(fileID, buffer, sourceManager, preprocessor.getLangOpts());
+    Token token;
+    uint64_t count = 0;
+    for (lexer.LexFromRawLexer(token); token.isNot(tok::eof); lexer.LexFromRawLexer(token)) {
+      count++;
+    }
+    return count;
+  }
+};
+
+// Decides which modules of a TU come from the shared export index. The first
+// TU to load a module file traverses its declarations and collects its macros
+// as before, then publishes them. Every later TU only records the module's
+// superclass links and matches against the published exports.
+class ModuleExportCollector {
+public:
+  ModuleExportCollector(CompilerInstance &compiler, TUContext &tuContext)
+    : compiler(compiler), tuContext(tuContext) {}
+
+  // Whether a top-level module's declarations are already in the index.
+  bool isIndexed(NameID module) {
+    return stateOf(module).indexed;
+  }
+
+  // Adds the macros of the modules this TU collected and publishes them. Every
+  // module the main file imports is looked up too, it may only define macros.
+  void finish(Preprocessor &preprocessor) {
+    if (!tuContext.moduleIndex) {
+      return;
+    }
+    for (NameID module : tuContext.modulesImported) {
+      StringRef name = tuContext.names.name(module);
+      stateOf(tuContext.names.intern(name.substr(0, name.find('.'))));
+    }
+
+    bool collecting = false;
+    for (auto &state : states) {
+      collecting |= state.second.collecting();
+    }
+    if (!collecting) {
+      return;
+    }
+    for (const auto &macro : preprocessor.macros()) {
+      for (ModuleMacro *moduleMacro : preprocessor.getLeafModuleMacros(macro.first)) {
+        Module *owner = moduleMacro->getOwningModule();
+        if (!owner) {
+          continue;
+        }
+        auto iter = states.find(tuContext.names.find(owner->getTopLevelModule()->Name));
+        if (iter != states.end() && iter->second.collecting()) {
+          Symbol symbol = {SymbolType::MacroDefinition, tuContext.names.intern(macro.first->getName())};
+          insertSymbolForFile(tuContext, iter->first, symbol, InvalidName);
+        }
+      }
+    }
+
+    SymbolSet empty;
+    for (auto &state : states) {
+      if (!state.second.collecting()) {
+        continue;
+      }
+      auto symbols = tuContext.symbolsForFile.find(state.first);
+      tuContext.moduleIndex->insert(state.second.key, makeModuleExports(tuContext.names,
+        symbols != tuContext.symbolsForFile.end() ? symbols->second : empty));
+    }
+  }
+
+private:
+  struct ModuleState {
+    // Empty if the module can't be indexed, it is then traversed every time.
+    std::string key;
+    bool indexed = false;
+
+    bool collecting() const {
+      return !indexed && !key.empty();
+    }
+  };
+
+  CompilerInstance &compiler;
+  TUContext &tuContext;
+  llvm::DenseMap<NameID, ModuleState> states;
+  std::string configuration;
+
+  ModuleState &stateOf(NameID module) {
+    auto inserted = states.insert(std::make_pair(module, ModuleState()));
+    ModuleState &state = inserted.first->second;
+    if (!inserted.second || !tuContext.moduleIndex) {
+      return state;
+    }
+    state.key = keyOf(tuContext.names.name(module));
+    if (state.key.empty()) {
+      return state;
+    }
+    if (std::shared_ptr<const ModuleExports> exports = tuContext.moduleIndex->find(state.key)) {
+      tuContext.stats.moduleIndexHits++;
+      state.indexed = true;
+      tuContext.indexedModules.push_back(std::make_pair(module, std::move(exports)));
+    } else {
+      tuContext.stats.moduleIndexMisses++;
+    }
+    return state;
+  }
+
+  // A module's exports depend on the module file they were loaded from, which
+  // is named by the module, the options it was built with and the file itself.
+  std::string keyOf(StringRef module) {
+    IntrusiveRefCntPtr<ASTReader> reader = compiler.getModuleManager();
+    if (!reader) {
+      return std::string();
+    }
+    serialization::ModuleFile *moduleFile = reader->getModuleManager().lookupByModuleName(module);
+    if (!moduleFile || !moduleFile->File) {
+      return std::string();
+    }
+    if (configuration.empty()) {
+      configuration = compiler.getInvocation().getModuleHash();
+    }
+    std::string key = module.str();
+    key += '\0';
+    key += configuration;
+    key += '\0';
+    key += moduleFile->FileName;
+    key += '\0';
+    key += std::to_string(moduleFile->File->getSize());
+    key += '\0';
+    key += std::to_string(static_cast<int64_t>(moduleFile->File->getModificationTime()));
+    return key;
+  }
 };
 
 class ObjcClassVisitor: public RecursiveASTVisitor<ObjcClassVisitor> {
 public:
-  explicit ObjcClassVisitor(ASTContext *context)
-    : context(context) {}
+  ObjcClassVisitor(ASTContext *context, TUContext &tuContext, FileClassifier &classifier, ModuleExportCollector &modules)
+    : context(context), tuContext(tuContext), classifier(classifier), modules(modules), types(tuContext.names) {}
+
+  // Walks a top-level declaration only as deep as its file can matter. Main
+  // file declarations are walked completely. Headers imported by the main file
+  // and module headers can only contribute declarations, so their bodies,
+  // parameters and expressions are skipped. Anything else, including modules
+  // an earlier TU already collected, is only checked for superclass links,
+  // which matchWithClass needs from every header.
+  bool TraverseTopLevelDecl(Decl *declaration) {
+    switch (scopeOf(declaration)) {
+      case TraversalScope::Main:
+        return TraverseDecl(declaration);
+      case TraversalScope::Declarations: {
+        walkBodies = false;
+        bool result = TraverseDecl(declaration);
+        walkBodies = true;
+        return result;
+      }
+      case TraversalScope::SuperClasses:
+        if (auto *interfaceDeclaration = dyn_cast<ObjCInterfaceDecl>(declaration)) {
+          if (interfaceDeclaration->isThisDeclarationADefinition()) {
+            recordSuperClass(interfaceDeclaration);
+          }
+        }
+        return true;
+    }
+    return true;
+  }
+
+  bool TraverseDecl(Decl *declaration) {
+    tuContext.stats.traversedDeclarations++;
+    return RecursiveASTVisitor::TraverseDecl(declaration);
+  }
+
+  bool TraverseStmt(Stmt *statement, DataRecursionQueue *queue = nullptr) {
+    if (!walkBodies) {
+      return true;
+    }
+    tuContext.stats.traversedStatements++;
+    return RecursiveASTVisitor::TraverseStmt(statement, queue);
+  }
+
+  bool TraverseParmVarDecl(ParmVarDecl *declaration) {
+    if (!walkBodies) {
+      return true;
+    }
+    return RecursiveASTVisitor::TraverseParmVarDecl(declaration);
+  }
 
   bool VisitImportDecl(ImportDecl *declaration) {
+    countVisit(VisitKind::ImportDecl);
     FullSourceLoc fullLocation = context->getFullLoc(declaration->getLocStart());
-    const SourceManager& sourceManager = context->getSourceManager();
     if (!fullLocation.isValid()) {
       return true;
     }
-    FileID declFileID = fullLocation.getFileID();
-    FileID mainFileID = sourceManager.getMainFileID();
-    if (declFileID.isValid() && mainFileID.isValid() && declFileID == mainFileID) {
-      std::string name = declaration->getImportedModule()->getFullModuleName();
-      modulesImported.insert(name);
-      lineNumbers[name] = fullLocation.getLineNumber();
+    if (classifier.classify(fullLocation).kind == FileInfo::Main) {
+      NameID name = tuContext.names.intern(declaration->getImportedModule()->getFullModuleName());
+      tuContext.modulesImported.insert(name);
+      tuContext.lineNumbers[name] = fullLocation.getLineNumber();
     }
     return true;
   }
 
   bool VisitObjCInterfaceDecl(ObjCInterfaceDecl *declaration) {
+    countVisit(VisitKind::ObjCInterfaceDecl);
     // Skip forward declarations
     if (!declaration->isThisDeclarationADefinition()) {
       return true;
@@ -326,12 +701,8 @@ public:
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::ClassDeclaration, declaration->getNameAsString());
-
-    ObjCInterfaceDecl *superDeclaration = declaration->getSuperClass();
-    if (superDeclaration) {
-      superClass.insert(std::pair<std::string, std::string>(declaration->getNameAsString(), superDeclaration->getNameAsString()));
-    }
+    Symbol symbol = makeSymbol(SymbolType::ClassDeclaration, declaration->getName());
+    recordSuperClass(declaration);
 
     if (addSymbolIfModule(fullLocation, symbol)) {
       return true;
@@ -343,12 +714,13 @@ public:
   }
 
   bool VisitObjCImplementationDecl(ObjCImplementationDecl *declaration) {
+    countVisit(VisitKind::ObjCImplementationDecl);
     FullSourceLoc fullLocation = context->getFullLoc(context->getSourceManager().getFileLoc(declaration->getLocStart()));
     if (!fullLocation.isValid()) {
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::Class, declaration->getNameAsString());
+    Symbol symbol = makeSymbol(SymbolType::Class, declaration->getName());
 
     addSymbolIfMain(fullLocation, symbol);
 
@@ -356,6 +728,7 @@ public:
   }
 
   bool VisitTypedefDecl(TypedefDecl *declaration) {
+    countVisit(VisitKind::TypedefDecl);
     // Only save final declarations (not forward declarations)
     if (declaration->getMostRecentDecl() != declaration) {
       return true;
@@ -366,7 +739,7 @@ public:
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::TypedefDeclaration, declaration->getNameAsString());
+    Symbol symbol = makeSymbol(SymbolType::TypedefDeclaration, declaration->getName());
 
     if (addSymbolIfModule(fullLocation, symbol)) {
       return true;
@@ -378,6 +751,7 @@ public:
   }
 
   bool VisitRecordDecl(RecordDecl *declaration) {
+    countVisit(VisitKind::RecordDecl);
     // Skip forward declarations
     if (!declaration->isThisDeclarationADefinition()) {
       return true;
@@ -398,7 +772,7 @@ public:
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::StructDeclaration, name.str());
+    Symbol symbol = makeSymbol(SymbolType::StructDeclaration, name);
 
     if (addSymbolIfModule(fullLocation, symbol)) {
       return true;
@@ -410,6 +784,7 @@ public:
   }
 
   bool VisitVarDecl(VarDecl *declaration) {
+    countVisit(VisitKind::VarDecl);
     StringRef name = declaration->getName();
     if (name.empty()) {
       return true;
@@ -425,12 +800,11 @@ public:
       if (type.isNull()) {
         return true;
       }
-      Symbol localVarSymbol = { SymbolType::Type, qualTypeSimple(type) };
-      addSymbolIfMain(fullLocation, localVarSymbol);
+      addTypeUsesIfMain(fullLocation, type);
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::VariableDeclaration, name.str());
+    Symbol symbol = makeSymbol(SymbolType::VariableDeclaration, name);
 
     if (addSymbolIfModule(fullLocation, symbol)) {
       return true;
@@ -439,13 +813,13 @@ public:
       return true;
     }
 
-    // Not technically needed, but seems like a good idea to keep it
-    Symbol variableDefinition = Symbol(SymbolType::Variable, name.str());
-    addSymbolIfMain(fullLocation, variableDefinition);
+    // Defining what a header declares uses the header.
+    useDeclarationIfMain(fullLocation, declaration);
     return true;
   }
 
   bool VisitFunctionDecl(FunctionDecl *declaration) {
+    countVisit(VisitKind::FunctionDecl);
     StringRef name = declaration->getName();
     if (name.empty()) {
       return true;
@@ -456,7 +830,7 @@ public:
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::FunctionDeclaration, name.str());
+    Symbol symbol = makeSymbol(SymbolType::FunctionDeclaration, name);
 
     if (addSymbolIfModule(fullLocation, symbol)) {
       return true;
@@ -465,13 +839,13 @@ public:
       return true;
     }
 
-    // Not technically needed, but seems like a good idea to keep it
-    Symbol functionDefinition = Symbol(SymbolType::Function, name.str());
-    addSymbolIfMain(fullLocation, functionDefinition);
+    // Defining what a header declares uses the header.
+    useDeclarationIfMain(fullLocation, declaration);
     return true;
   }
 
   bool VisitEnumDecl(EnumDecl *declaration) {
+    countVisit(VisitKind::EnumDecl);
     // Skip forward declarations
     if (!declaration->isThisDeclarationADefinition()) {
       return true;
@@ -487,7 +861,7 @@ public:
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::EnumDeclaration, name.str());
+    Symbol symbol = makeSymbol(SymbolType::EnumDeclaration, name);
 
     if (addSymbolIfModule(fullLocation, symbol)) {
       return true;
@@ -499,6 +873,7 @@ public:
   }
 
   bool VisitEnumConstantDecl(EnumConstantDecl *declaration) {
+    countVisit(VisitKind::EnumConstantDecl);
     StringRef name = declaration->getName();
     if (name.empty()) {
       return true;
@@ -509,7 +884,7 @@ public:
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::EnumConstantDeclaration, name.str());
+    Symbol symbol = makeSymbol(SymbolType::EnumConstantDeclaration, name);
 
     if (addSymbolIfModule(fullLocation, symbol)) {
       return true;
@@ -521,6 +896,7 @@ public:
   }
 
   bool VisitObjCProtocolDecl(ObjCProtocolDecl *declaration) {
+    countVisit(VisitKind::ObjCProtocolDecl);
     // Skip forward declarations
     if (!declaration->isThisDeclarationADefinition()) {
       return true;
@@ -536,7 +912,7 @@ public:
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::ProtocolDeclaration, name.str());
+    Symbol symbol = makeSymbol(SymbolType::ProtocolDeclaration, name);
 
     if (addSymbolIfModule(fullLocation, symbol)) {
       return true;
@@ -548,12 +924,13 @@ public:
   }
 
   bool VisitObjCCategoryDecl(ObjCCategoryDecl *declaration) {
+    countVisit(VisitKind::ObjCCategoryDecl);
     FullSourceLoc fullLocation = context->getFullLoc(context->getSourceManager().getFileLoc(declaration->getLocStart()));
     if (!fullLocation.isValid()) {
       return true;
     }
 
-    Symbol categorySymbol = Symbol(SymbolType::CategoryDeclaration, declaration->getNameAsString());
+    Symbol categorySymbol = makeSymbol(SymbolType::CategoryDeclaration, declaration->getName());
     addSymbolIfIncludedByMain(fullLocation, categorySymbol);
 
     for (auto protocol : declaration->getReferencedProtocols()) {
@@ -561,7 +938,7 @@ public:
       if (name.empty()) {
         continue;
       }
-      Symbol symbol = Symbol(SymbolType::Protocol, name.str());
+      Symbol symbol = makeSymbol(SymbolType::Protocol, name);
       addSymbolIfMain(fullLocation, symbol);
 
       auto *classDecl = declaration->getClassInterface();
@@ -572,11 +949,11 @@ public:
       if (className.empty()) {
         continue;
       }
-      Symbol conformSymbol = Symbol(SymbolType::ProtocolConformanceDeclaration, name.str());
-      if (addSymbolIfModule(fullLocation, conformSymbol, className.str())) {
+      Symbol conformSymbol = makeSymbol(SymbolType::ProtocolConformanceDeclaration, name);
+      if (addSymbolIfModule(fullLocation, conformSymbol, className)) {
         continue;
       }
-      if (addSymbolIfIncludedByMain(fullLocation, conformSymbol, className.str())) {
+      if (addSymbolIfIncludedByMain(fullLocation, conformSymbol, className)) {
         continue;
       }
     }
@@ -584,16 +961,17 @@ public:
   }
 
   bool VisitObjCCategoryImplDecl(ObjCCategoryImplDecl *declaration) {
+    countVisit(VisitKind::ObjCCategoryImplDecl);
     FullSourceLoc fullLocation = context->getFullLoc(context->getSourceManager().getFileLoc(declaration->getLocStart()));
     if (!fullLocation.isValid()) {
       return true;
     }
 
-    Symbol categorySymbol = Symbol(SymbolType::Category, declaration->getNameAsString());
+    Symbol categorySymbol = makeSymbol(SymbolType::Category, declaration->getName());
     addSymbolIfMain(fullLocation, categorySymbol);
 
     if (ObjCInterfaceDecl *classDeclaration = declaration->getClassInterface()) {
-      Symbol classSymbol = Symbol(SymbolType::Class, classDeclaration->getNameAsString());
+      Symbol classSymbol = makeSymbol(SymbolType::Class, classDeclaration->getName());
       addSymbolIfMain(fullLocation, classSymbol);
     }
 
@@ -601,6 +979,7 @@ public:
   }
 
   bool VisitObjCMethodDecl(ObjCMethodDecl *declaration) {
+    countVisit(VisitKind::ObjCMethodDecl);
     Selector selector = declaration->getSelector();
     if (selector.isNull()) {
       return true;
@@ -621,7 +1000,7 @@ public:
         if (auto *classDecl = categoryDecl->getClassInterface()) {
           nameRef = classDecl->getName();
         } else {
-          llvm::outs() << "error: MethodDecl has parent ObjCCategoryDecl with no class\n";
+          reportError("MethodDecl has parent ObjCCategoryDecl with no class");
           return true;
         }
       } else if (auto *implDecl = dyn_cast<ObjCImplDecl>(parent)) {
@@ -634,67 +1013,39 @@ public:
           return true;
         }
 
-        Symbol definitionSymbol = Symbol(SymbolType::Method, selector.getAsString());
-        addSymbolIfMain(fullLocation, definitionSymbol, className.str());
+        Symbol definitionSymbol = makeSymbol(SymbolType::Method, selector);
+        addSymbolIfMain(fullLocation, definitionSymbol, className);
 
-        QualType returnType = declaration->getReturnType();
-        if (!returnType.isNull()) {
-          Symbol returnSymbol = Symbol(SymbolType::Type, qualTypeSimple(returnType));
-          addSymbolIfMain(fullLocation, returnSymbol);
-        }
+        addTypeUsesIfMain(fullLocation, declaration->getReturnType());
 
-        // This is terrible, but it's only here because we do "casts" to add protocol conformance (this really can't be safe).
+        // Every protocol a parameter is qualified with is used, we do "casts" to
+        // add protocol conformance.
         for (ParmVarDecl *param : declaration->parameters()) {
-          QualType qualType = param->getOriginalType();
-          if (qualType.isNull()) {
-            continue;
-          }
-          const clang::Type *typePtr = qualType.getTypePtr();
-          if (!typePtr) {
-            continue;
-          }
-          auto string = qualTypeSimple(qualType);
-          size_t index = 0;
-          while (true) {
-            auto end_index = string.find(',', index);
-            std::string partial_string;
-            if (end_index == std::string::npos) {
-              partial_string = string.substr(index);
-            } else {
-              auto length = end_index - index;
-              partial_string = string.substr(index, length);
-            }
-            Symbol protocolSymbol = Symbol(SymbolType::Type, partial_string);
-            addSymbolIfMain(fullLocation, protocolSymbol);
-            if (end_index == std::string::npos) {
-              break;
-            }
-            index = end_index + 1;
-          }
+          addTypeUsesIfMain(fullLocation, param->getOriginalType());
         }
 
         return true;
       } else {
         const char *kindName = parent->getDeclKindName();
         if (kindName) {
-          llvm::outs() << "error: MethodDecl with unsupported parent: " << kindName << "\n";
+          reportError("MethodDecl with unsupported parent: " + Twine(kindName));
         }
         return true;
       }
     } else {
-      llvm::outs() << "error: MethodDecl has null parent\n";
+      reportError("MethodDecl has null parent");
       return true;
     }
     if (nameRef.empty()) {
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::MethodDeclaration, selector.getAsString());
+    Symbol symbol = makeSymbol(SymbolType::MethodDeclaration, selector);
 
-    if (addSymbolIfModule(fullLocation, symbol, nameRef.str())) {
+    if (addSymbolIfModule(fullLocation, symbol, nameRef)) {
       return true;
     }
-    if (addSymbolIfIncludedByMain(fullLocation, symbol, nameRef.str())) {
+    if (addSymbolIfIncludedByMain(fullLocation, symbol, nameRef)) {
       return true;
     }
 
@@ -702,6 +1053,7 @@ public:
   }
 
   bool VisitObjCMessageExpr(ObjCMessageExpr *expression) {
+    countVisit(VisitKind::ObjCMessageExpr);
     Selector selector = expression->getSelector();
     if (selector.isNull()) {
       return true;
@@ -724,8 +1076,7 @@ public:
         if (returnTypePtr->isObjCObjectPointerType()
          && !returnTypePtr->isObjCIdType()
          && !returnTypePtr->isObjCClassOrClassKindOfType()) {
-          Symbol typeSymbol = Symbol(SymbolType::Type, qualTypeSimple(returnType));
-          addSymbolIfMain(fullLocation, typeSymbol);
+          addTypeUsesIfMain(fullLocation, returnType);
         }
       }
     }
@@ -736,20 +1087,14 @@ public:
         if (!receiverClass->isObjCId()) {
           QualType baseType = receiverClass->getBaseType();
           if (!baseType.isNull()) {
-            Symbol symbol = Symbol(SymbolType::Method, selector.getAsString());
-            addSymbolIfMain(fullLocation, symbol, qualTypeSimple(baseType));
-            Symbol typeSymbol = Symbol(SymbolType::Type, qualTypeSimple(baseType));
-            addSymbolIfMain(fullLocation, typeSymbol);
+            addReceiverUsesIfMain(fullLocation, makeSymbol(SymbolType::Method, selector), baseType, true);
           }
         }
       } else if (auto *receiverClassPtr = receiverTypePtr->getAsObjCInterfacePointerType()) {
         if (!receiverClassPtr->isObjCIdType()) {
           QualType baseType = receiverClassPtr->getObjectType()->getBaseType();
           if (!baseType.isNull()) {
-            Symbol symbol = Symbol(SymbolType::Method, selector.getAsString());
-            addSymbolIfMain(fullLocation, symbol, qualTypeSimple(baseType));
-            Symbol typeSymbol = Symbol(SymbolType::Type, qualTypeSimple(baseType));
-            addSymbolIfMain(fullLocation, typeSymbol);
+            addReceiverUsesIfMain(fullLocation, makeSymbol(SymbolType::Method, selector), baseType, true);
           }
         }
       } else if (receiverTypePtr->isObjCClassType()) {
@@ -758,8 +1103,7 @@ public:
             if (auto *propertyRefExpr = dyn_cast<ObjCPropertyRefExpr>(pseudoExpr->getSyntacticForm())) {
               QualType realType = propertyRefExpr->getReceiverType(*context);
               if (!realType.isNull()) {
-                Symbol symbol = Symbol(SymbolType::Method, selector.getAsString());
-                addSymbolIfMain(fullLocation, symbol, qualTypeSimple(realType));
+                addReceiverUsesIfMain(fullLocation, makeSymbol(SymbolType::Method, selector), realType, false);
               }
             }
           }
@@ -768,14 +1112,8 @@ public:
       }
     }
 
-    std::string receiverTypeName = qualTypeSimple(receiverType);
-
-    Symbol symbol = Symbol(SymbolType::Method, selector.getAsString());
-    addSymbolIfMain(fullLocation, symbol, receiverTypeName);
-    if (expression->isClassMessage()) {
-      Symbol typeSymbol = Symbol(SymbolType::Type, receiverTypeName);
-      addSymbolIfMain(fullLocation, typeSymbol);
-    }
+    addReceiverUsesIfMain(fullLocation, makeSymbol(SymbolType::Method, selector), receiverType,
+                          expression->isClassMessage());
 
     // Check parameters to see if protocol conformance is needed
     auto arguments = expression->arg_begin();
@@ -800,8 +1138,11 @@ public:
         continue;
       }
       if (typePtr->isObjCQualifiedIdType() || typePtr->isObjCQualifiedClassType()) {
-        Symbol protocolSymbol = Symbol(SymbolType::ProtocolConformance, qualTypeSimple(qualType));
-        addSymbolIfMain(fullLocation, protocolSymbol, qualTypeSimple(argType));
+        SmallVector<NameID, 4> protocols;
+        types.protocolNames(qualType, protocols);
+        for (NameID protocol : protocols) {
+          addReceiverUsesIfMain(fullLocation, Symbol{SymbolType::ProtocolConformance, protocol}, argType, false);
+        }
       }
     }
 
@@ -809,6 +1150,7 @@ public:
   }
 
   bool VisitObjCPropertyDecl(ObjCPropertyDecl *declaration) {
+    countVisit(VisitKind::ObjCPropertyDecl);
     StringRef name = declaration->getName();
     if (name.empty()) {
       return true;
@@ -833,25 +1175,21 @@ public:
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::PropertyDeclaration, name.str());
+    Symbol symbol = makeSymbol(SymbolType::PropertyDeclaration, name);
 
-    if (addSymbolIfModule(fullLocation, symbol, className.str())) {
+    if (addSymbolIfModule(fullLocation, symbol, className)) {
       return true;
     }
-    if (addSymbolIfIncludedByMain(fullLocation, symbol, className.str())) {
+    if (addSymbolIfIncludedByMain(fullLocation, symbol, className)) {
       return true;
     }
 
-    QualType type = declaration->getType();
-    if (type.isNull()) {
-      return true;
-    }
-    Symbol typeSymbol = Symbol(SymbolType::Type, qualTypeSimple(type));
-    addSymbolIfMain(fullLocation, typeSymbol);
+    addTypeUsesIfMain(fullLocation, declaration->getType());
     return true;
   }
 
   bool VisitObjCPropertyRefExpr(ObjCPropertyRefExpr *expression) {
+    countVisit(VisitKind::ObjCPropertyRefExpr);
     FullSourceLoc fullLocation = context->getFullLoc(context->getSourceManager().getFileLoc(expression->getLocStart()));
     if (!fullLocation.isValid()) {
       return true;
@@ -875,282 +1213,1428 @@ public:
       return true;
     }
 
-    Symbol symbol = Symbol(SymbolType::Property, name.str());
-    addSymbolIfMain(fullLocation, symbol, qualTypeSimple(receiver));
+    addReceiverUsesIfMain(fullLocation, makeSymbol(SymbolType::Property, name), receiver, false);
 
     return true;
   }
 
   bool VisitParmVarDecl(ParmVarDecl *declaration) {
+    countVisit(VisitKind::ParmVarDecl);
     FullSourceLoc fullLocation = context->getFullLoc(context->getSourceManager().getFileLoc(declaration->getLocStart()));
     if (!fullLocation.isValid()) {
       return true;
     }
 
-    auto type = declaration->getOriginalType();
-    if (type.isNull()) {
-      return true;
-    }
-
-    Symbol symbol = Symbol(SymbolType::Type, qualTypeSimple(type));
-    addSymbolIfMain(fullLocation, symbol);
+    addTypeUsesIfMain(fullLocation, declaration->getOriginalType());
 
     return true;
   }
 
   bool VisitDeclRefExpr(DeclRefExpr *expression) {
+    countVisit(VisitKind::DeclRefExpr);
     FullSourceLoc fullLocation = context->getFullLoc(context->getSourceManager().getFileLoc(expression->getLocStart()));
     if (!fullLocation.isValid()) {
       return true;
     }
 
-    auto *declaration = expression->getFoundDecl();
-
-    StringRef nameRef = declaration->getName();
-    if (nameRef.empty()) {
+    ValueDecl *declaration = expression->getDecl();
+    if (declaration->getName().empty()) {
       return true;
     }
 
-    SymbolType type;
-    std::string name = nameRef.str();
-    if (strcmp(declaration->getDeclKindName(), "Var") == 0) {
-      VarDecl *varDecl = (VarDecl *) declaration;
-      if (!varDecl->hasGlobalStorage() || varDecl->isStaticLocal()) {
+    if (auto *variable = dyn_cast<VarDecl>(declaration)) {
+      // Parameters and locals are never declared by an import.
+      if (!variable->hasGlobalStorage() || variable->isStaticLocal()) {
         return true;
       }
-      type = SymbolType::Variable;
-    } else if (strcmp(declaration->getDeclKindName(), "Function") == 0) {
-      type = SymbolType::Function;
-    } else if (strcmp(declaration->getDeclKindName(), "EnumConstant") == 0) {
-      type = SymbolType::EnumConstant;
-    } else if (strcmp(declaration->getDeclKindName(), "ParmVar") == 0) {
-      // Skip ParmVar usage
-      return true;
-    } else if (strcmp(declaration->getDeclKindName(), "ImplicitParam") == 0) {
-      // Skip ParmVar usage
-      return true;
-    } else {
-      llvm::outs() << "error: Unknown DeclKind: " << declaration->getDeclKindName() << " - " << name << "\n";
+    } else if (!isa<FunctionDecl>(declaration) && !isa<EnumConstantDecl>(declaration)) {
+      reportError("Unknown DeclKind: " + Twine(declaration->getDeclKindName()) + " - " + declaration->getName());
       const FileEntry *file = fullLocation.getFileEntry();
       if (file) {
-        llvm::outs() << "InFile: " << file->getName() << "\n";
+        tuContext.diagnostics += ("InFile: " + file->getName() + "\n").str();
       }
       return true;
     }
 
-     Symbol symbol = Symbol(type, name);
-     addSymbolIfMain(fullLocation, symbol);
-
+    useDeclarationIfMain(fullLocation, declaration);
     return true;
   }
 
+  // Attributes each declaration the main file used to the import declaring
+  // it. Classes, protocols and tags are attributed where they are defined,
+  // like the symbols headers declare, everything else to all its
+  // redeclarations.
+  void resolveUsedDeclarations() {
+    const SourceManager &sourceManager = context->getSourceManager();
+    auto use = [&](const Decl *declaration) {
+      FileInfo info = classifier.classify(sourceManager.getFileLoc(declaration->getLocStart()));
+      if (info.kind == FileInfo::IncludedByMain || info.kind == FileInfo::Module) {
+        tuContext.usedImports.insert(info.name);
+      }
+    };
+    for (const Decl *declaration : tuContext.usedDeclarations) {
+      if (auto *interface = dyn_cast<ObjCInterfaceDecl>(declaration)) {
+        if (const ObjCInterfaceDecl *definition = interface->getDefinition()) {
+          use(definition);
+        }
+      } else if (auto *protocol = dyn_cast<ObjCProtocolDecl>(declaration)) {
+        if (const ObjCProtocolDecl *definition = protocol->getDefinition()) {
+          use(definition);
+        }
+      } else if (auto *tag = dyn_cast<TagDecl>(declaration)) {
+        if (const TagDecl *definition = tag->getDefinition()) {
+          use(definition);
+        }
+      } else {
+        for (const Decl *redeclaration : declaration->redecls()) {
+          use(redeclaration);
+        }
+      }
+    }
+  }
+
 private:
+  enum class TraversalScope {
+    Main,
+    Declarations,
+    SuperClasses
+  };
+
   ASTContext *context;
+  TUContext &tuContext;
+  FileClassifier &classifier;
+  ModuleExportCollector &modules;
+  TypeResolver types;
+  bool walkBodies = true;
 
-  bool addSymbolIfModule(FullSourceLoc& fullLocation, Symbol& symbol, std::string className = "") {
+  TraversalScope scopeOf(Decl *declaration) {
     const SourceManager& sourceManager = context->getSourceManager();
-    return ::addSymbolIfModule(sourceManager, fullLocation, symbol, className);
+    FileInfo info = classifier.classify(sourceManager.getFileLoc(declaration->getLocStart()));
+    switch (info.kind) {
+      case FileInfo::Main:
+        return TraversalScope::Main;
+      case FileInfo::IncludedByMain:
+        return TraversalScope::Declarations;
+      case FileInfo::Module:
+        return modules.isIndexed(info.name) ? TraversalScope::SuperClasses : TraversalScope::Declarations;
+      case FileInfo::Irrelevant:
+        return TraversalScope::SuperClasses;
+    }
+    return TraversalScope::SuperClasses;
   }
 
-  bool addSymbolIfIncludedByMain(FullSourceLoc& fullLocation, Symbol& symbol, std::string className = "") {
-    const SourceManager& sourceManager = context->getSourceManager();
-    return ::addSymbolIfIncludedByMain(sourceManager, context, fullLocation, symbol, className);
+  void recordSuperClass(ObjCInterfaceDecl *declaration) {
+    if (ObjCInterfaceDecl *superDeclaration = declaration->getSuperClass()) {
+      NameID className = tuContext.names.intern(declaration->getName());
+      tuContext.superClass.insert(std::make_pair(className, tuContext.names.intern(superDeclaration->getName())));
+    }
   }
 
-  void addSymbolIfMain(FullSourceLoc& fullLocation, Symbol& symbol, std::string className = "") {
-    const SourceManager& sourceManager = context->getSourceManager();
-    return ::addSymbolIfMain(sourceManager, fullLocation, symbol, className);
+  void countVisit(VisitKind kind) {
+    tuContext.stats.visits[static_cast<size_t>(kind)]++;
   }
 
-  std::string qualTypeSimple(QualType type) {
-    std::string fullString = type.stripObjCKindOfType(*context).getUnqualifiedType().getAsString();
-    std::string string = getUpToFirstSpace(fullString);
-    auto start_index = string.find_first_of('<');
-    if (start_index == std::string::npos) {
-      return string;
-    }
-    auto end_index = string.find_first_of('>');
-    if (end_index == std::string::npos) {
-      return string.substr(start_index + 1);
-    }
-    if (start_index > end_index) {
-      return string;
-    }
-    auto length = end_index - start_index;
-    return string.substr(start_index + 1, length - 1);
+  Symbol makeSymbol(SymbolType type, StringRef name) {
+    return Symbol{type, tuContext.names.intern(name)};
   }
 
-  std::string getUpToFirstSpace(std::string string) {
-    auto index = string.find_first_of(' ');
-    if (index == std::string::npos) {
-      return string;
+  Symbol makeSymbol(SymbolType type, Selector selector) {
+    auto inserted = tuContext.selectorNames.insert(std::make_pair(selector.getAsOpaquePtr(), InvalidName));
+    if (inserted.second) {
+      tuContext.stats.selectorNameMisses++;
+      inserted.first->second = tuContext.names.intern(selector.getAsString());
     } else {
-      return string.substr(0, index);
+      tuContext.stats.selectorNameHits++;
     }
+    return Symbol{type, inserted.first->second};
   }
-};
 
-class ObjcClassConsumer : public clang::ASTConsumer {
-public:
-  explicit ObjcClassConsumer(ASTContext *context, Preprocessor &PP)
-    : visitor(context) {
-      PP.addPPCallbacks(llvm::make_unique<PPCallbacksTracker>(PP, context));
-    }
+  NameID internClassName(StringRef name) {
+    return name.empty() ? InvalidName : tuContext.names.intern(name);
+  }
 
-  virtual void HandleTranslationUnit(clang::ASTContext &context) {
-    visitor.TraverseDecl(context.getTranslationUnitDecl());
+  bool addSymbolIfModule(FullSourceLoc& fullLocation, Symbol symbol, StringRef className = StringRef()) {
+    return ::addSymbolIfModule(tuContext, classifier.classify(fullLocation), symbol, internClassName(className));
   }
-private:
-  ObjcClassVisitor visitor;
-};
 
-class ObjcClassAction : public clang::ASTFrontendAction {
-public:
-  virtual std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
-    clang::CompilerInstance &compiler, llvm::StringRef inFile) {
-    return std::unique_ptr<clang::ASTConsumer>(
-        new ObjcClassConsumer(&compiler.getASTContext(), compiler.getPreprocessor()));
+  bool addSymbolIfIncludedByMain(FullSourceLoc& fullLocation, Symbol symbol, StringRef className = StringRef()) {
+    return ::addSymbolIfIncludedByMain(tuContext, classifier.classify(fullLocation), symbol, internClassName(className));
   }
-};
 
-bool hasEnding(std::string const &fullString, std::string const &ending) {
-    if (fullString.length() >= ending.length()) {
-        return (0 == fullString.compare(fullString.length() - ending.length(), ending.length(), ending));
-    } else {
-        return false;
+  void addSymbolIfMain(FullSourceLoc& fullLocation, Symbol symbol, StringRef className = StringRef()) {
+    return ::addSymbolIfMain(tuContext, classifier.classify(fullLocation), symbol, internClassName(className));
+  }
+
+  void reportError(const Twine &message) {
+    tuContext.diagnostics += ("error: " + message + "\n").str();
+  }
+
+  void useDeclarationIfMain(FullSourceLoc& fullLocation, const Decl *declaration) {
+    if (classifier.classify(fullLocation).kind == FileInfo::Main) {
+      tuContext.usedDeclarations.insert(declaration->getCanonicalDecl());
     }
-}
+  }
 
-bool isSameOrSubClass(std::string referenceClass, std::string testClass) {
-  auto className = testClass;
-  while(true) {
-    if (referenceClass == className) {
-      return true;
+  // The typedefs, classes and protocols a main file type is spelled with.
+  void addTypeUsesIfMain(FullSourceLoc& fullLocation, QualType type) {
+    if (type.isNull() || classifier.classify(fullLocation).kind != FileInfo::Main) {
+      return;
     }
-    auto iter = superClass.find(className);
-    if (iter == superClass.end()) {
-      return false;
-    } else {
-      className = iter->second;
+    SmallVector<const NamedDecl *, 4> declarations;
+    types.typeDeclarations(type, declarations);
+    for (const NamedDecl *declaration : declarations) {
+      tuContext.usedDeclarations.insert(declaration->getCanonicalDecl());
     }
   }
 
-  return false;
-}
-
-bool matchWithClass(const Symbol &symbol, SymbolType type, std::unordered_set<Symbol> symbols) {
-  auto mainFileSymbol = symbols.find(Symbol(type, symbol.value));
-  if (mainFileSymbol == symbols.end()) {
-    return false;
+  // A member used on a receiver, once for each class it can be looked up in.
+  // A class message also uses the class as a type.
+  void addReceiverUsesIfMain(FullSourceLoc& fullLocation, Symbol symbol, QualType receiverType, bool usesType) {
+    if (classifier.classify(fullLocation).kind != FileInfo::Main) {
+      return;
+    }
+    SmallVector<NameID, 4> receiverNames;
+    types.receiverNames(receiverType, receiverNames);
+    for (NameID name : receiverNames) {
+      ::addSymbolIfMain(tuContext, classifier.classify(fullLocation), symbol, name);
+    }
+    if (usesType) {
+      addTypeUsesIfMain(fullLocation, receiverType);
+    }
   }
+};
 
-  if (!symbol.classNames || !mainFileSymbol->classNames) {
-    return false;
-  }
+// Classifies how a header subject uses the declarations of its imports. A
+// class or protocol that is only named in pointer types can be forward
+// declared, everything else needs the import. Only declarations in the main
+// file are walked.
+class HeaderUseVisitor : public RecursiveASTVisitor<HeaderUseVisitor> {
+public:
+  HeaderUseVisitor(ASTContext *context, TUContext &tuContext, FileClassifier &classifier)
+    : context(context), tuContext(tuContext), classifier(classifier) {}
 
-  for (auto &className : *(symbol.classNames)) {
-    for (auto &mainFileClassName : *(mainFileSymbol->classNames)) {
-      // Be conservative with methods called on id
-      if (mainFileClassName == "id") {
-        return true;
-      }
-      if (isSameOrSubClass(className, mainFileClassName)) {
-        return true;
-      }
+  bool VisitObjCInterfaceDecl(ObjCInterfaceDecl *declaration) {
+    if (!declaration->isThisDeclarationADefinition()) {
+      return true;
+    }
+    if (ObjCInterfaceDecl *superDeclaration = declaration->getSuperClass()) {
+      needDefinition(superDeclaration);
+    }
+    for (ObjCProtocolDecl *protocol : declaration->protocols()) {
+      needDefinition(protocol);
     }
+    return true;
   }
-  return false;
-}
 
-bool symbolUsed(const Symbol &symbol, std::unordered_set<Symbol> symbols) {
-  switch (symbol.type) {
-    case SymbolType::ClassDeclaration:
-      return symbols.find(Symbol(SymbolType::Class, symbol.value)) != symbols.end() || symbols.find(Symbol(SymbolType::Type, symbol.value)) != symbols.end();
-    case SymbolType::TypedefDeclaration:
-      return symbols.find(Symbol(SymbolType::Type, symbol.value)) != symbols.end();
-    case SymbolType::StructDeclaration:
-      return symbols.find(Symbol(SymbolType::Struct, symbol.value)) != symbols.end();
-    case SymbolType::VariableDeclaration:
-      return symbols.find(Symbol(SymbolType::Variable, symbol.value)) != symbols.end();
-    case SymbolType::FunctionDeclaration:
-      return symbols.find(Symbol(SymbolType::Function, symbol.value)) != symbols.end();
-    case SymbolType::EnumDeclaration:
-      return symbols.find(Symbol(SymbolType::Enum, symbol.value)) != symbols.end();
-    case SymbolType::ProtocolDeclaration:
-      return symbols.find(Symbol(SymbolType::Protocol, symbol.value)) != symbols.end() || symbols.find(Symbol(SymbolType::Type, symbol.value)) != symbols.end();
-    case SymbolType::EnumConstantDeclaration:
-      return symbols.find(Symbol(SymbolType::EnumConstant, symbol.value)) != symbols.end();
-    case SymbolType::MethodDeclaration:
-      return matchWithClass(symbol, SymbolType::Method, symbols);
-    case SymbolType::PropertyDeclaration:
-      return matchWithClass(symbol, SymbolType::Property, symbols) || matchWithClass(symbol, SymbolType::Method, symbols);
-    case SymbolType::MacroDefinition:
-      return symbols.find(Symbol(SymbolType::Macro, symbol.value)) != symbols.end();
-    case SymbolType::ProtocolConformanceDeclaration:
-      return matchWithClass(symbol, SymbolType::ProtocolConformance, symbols);
-    case SymbolType::CategoryDeclaration:
-      return symbols.find(Symbol(SymbolType::Category, symbol.value)) != symbols.end();
-    default:
-      return false;
+  bool VisitObjCCategoryDecl(ObjCCategoryDecl *declaration) {
+    if (ObjCInterfaceDecl *classDeclaration = declaration->getClassInterface()) {
+      needDefinition(classDeclaration);
+    }
+    for (ObjCProtocolDecl *protocol : declaration->protocols()) {
+      needDefinition(protocol);
+    }
+    return true;
   }
-}
 
-bool anySymbolUsed(std::unordered_set<Symbol> symbols, std::unordered_set<Symbol> referenceSymbols) {
-  for (auto &symbol : symbols) {
-    if (symbolUsed(symbol, referenceSymbols)) {
+  bool VisitObjCProtocolDecl(ObjCProtocolDecl *declaration) {
+    if (!declaration->isThisDeclarationADefinition()) {
       return true;
     }
+    for (ObjCProtocolDecl *protocol : declaration->protocols()) {
+      needDefinition(protocol);
+    }
+    return true;
   }
-  return false;
-}
 
-int main(int argc, const char **argv) {
-  CommonOptionsParser optionsParser(argc, argv, toolCategory);
-  ClangTool tool(optionsParser.getCompilations(),
-                 optionsParser.getSourcePathList());
-  int result = tool.run(newFrontendActionFactory<ObjcClassAction>().get());
-
-  std::string file = optionsParser.getSourcePathList().front();
-  auto mainSymbolsIter = symbolsForFile.find(file);
-  std::unordered_set<Symbol> mainSymbols;
-  if (mainSymbolsIter != symbolsForFile.end()) {
-    mainSymbols = mainSymbolsIter->second;
-  } else {
-    mainSymbols = std::unordered_set<Symbol>();
+  bool VisitObjCMethodDecl(ObjCMethodDecl *declaration) {
+    useType(declaration->getReturnType(), false);
+    return true;
   }
 
-  if (DebugPrint) {
-    for (auto &pair : symbolsForFile) {
-      llvm::outs() << "File: " << pair.first << "\n";
-      for (auto &symbol : pair.second) {
-        if (symbol.classNames) {
-          for (auto name : *(symbol.classNames)) {
-            llvm::outs() << symbolTypeToString(symbol.type) << ": " << name << " " << symbol.value << "\n";
-          }
-        } else {
-          llvm::outs() << symbolTypeToString(symbol.type) << ": " << symbol.value << "\n";
-        }
-      }
-      llvm::outs() << "\n";
-    }
+  bool VisitObjCPropertyDecl(ObjCPropertyDecl *declaration) {
+    useType(declaration->getType(), false);
+    return true;
+  }
 
-    llvm::outs() << "\n" << "Modules:\n";
-    for (auto &module : modulesImported) {
-      llvm::outs() << module << "\n";
-    }
-    llvm::outs() << "\n";
+  // Variables, parameters, fields, instance variables and functions.
+  bool VisitDeclaratorDecl(DeclaratorDecl *declaration) {
+    useType(declaration->getType(), false);
+    return true;
+  }
 
-    llvm::outs() << "Unused Imports:\n";
+  bool VisitTypedefNameDecl(TypedefNameDecl *declaration) {
+    useType(declaration->getUnderlyingType(), false);
+    return true;
   }
-  for (auto &pair : symbolsForFile) {
-    if (!hasEnding(pair.first, ".h") && modulesImported.find(pair.first) == modulesImported.end()) {
-      continue;
-    }
 
-    if (!anySymbolUsed(pair.second, mainSymbols)) {
-      llvm::outs() << file << ":" << lineNumbers[pair.first] << ": warning: Unused import " << pair.first << "\n";
+  bool VisitEnumDecl(EnumDecl *declaration) {
+    if (TypeSourceInfo *integerType = declaration->getIntegerTypeSourceInfo()) {
+      useType(integerType->getType(), false);
     }
+    return true;
   }
 
-  return result;
-}
\ No newline at end of file
+  // Inline functions and initializers.
+  bool VisitDeclRefExpr(DeclRefExpr *expression) {
+    needDefinition(expression->getDecl());
+    return true;
+  }
+
+  bool VisitObjCMessageExpr(ObjCMessageExpr *expression) {
+    if (const ObjCMethodDecl *method = expression->getMethodDecl()) {
+      needDefinition(method);
+    }
+    if (ObjCInterfaceDecl *receiver = expression->getReceiverInterface()) {
+      needDefinition(receiver);
+    }
+    return true;
+  }
+
+  bool VisitObjCPropertyRefExpr(ObjCPropertyRefExpr *expression) {
+    if (!expression->isImplicitProperty()) {
+      needDefinition(expression->getExplicitProperty());
+    }
+    return true;
+  }
+
+  bool VisitObjCProtocolExpr(ObjCProtocolExpr *expression) {
+    needDefinition(expression->getProtocol());
+    return true;
+  }
+
+private:
+  ASTContext *context;
+  TUContext &tuContext;
+  FileClassifier &classifier;
+
+  // `throughPointer` is set once the type is behind a pointer, where structs
+  // only need to be declared.
+  void useType(QualType type, bool throughPointer) {
+    while (!type.isNull()) {
+      const clang::Type *typePtr = type.getTypePtr();
+      // A typedef can't be forward declared, whatever it names.
+      if (auto *typedefType = dyn_cast<TypedefType>(typePtr)) {
+        needDefinition(typedefType->getDecl());
+        return;
+      }
+      if (auto *objectPointer = dyn_cast<ObjCObjectPointerType>(typePtr)) {
+        useObjectType(objectPointer->getObjectType());
+        return;
+      }
+      if (auto *objectType = dyn_cast<ObjCObjectType>(typePtr)) {
+        useObjectType(objectType);
+        return;
+      }
+      if (auto *pointer = dyn_cast<PointerType>(typePtr)) {
+        type = pointer->getPointeeType();
+        throughPointer = true;
+        continue;
+      }
+      if (auto *blockPointer = dyn_cast<BlockPointerType>(typePtr)) {
+        type = blockPointer->getPointeeType();
+        throughPointer = true;
+        continue;
+      }
+      if (auto *array = dyn_cast<ArrayType>(typePtr)) {
+        type = array->getElementType();
+        continue;
+      }
+      if (auto *function = dyn_cast<FunctionType>(typePtr)) {
+        useType(function->getReturnType(), throughPointer);
+        if (auto *prototype = dyn_cast<FunctionProtoType>(function)) {
+          for (QualType parameter : prototype->getParamTypes()) {
+            useType(parameter, throughPointer);
+          }
+        }
+        return;
+      }
+      if (auto *record = dyn_cast<RecordType>(typePtr)) {
+        RecordDecl *declaration = record->getDecl();
+        if (throughPointer && !declaration->getName().empty()) {
+          useThroughPointer(declaration, (Twine(declaration->getKindName()) + " " + declaration->getName() + ";").str());
+        } else {
+          needDefinition(declaration);
+        }
+        return;
+      }
+      if (auto *enumType = dyn_cast<EnumType>(typePtr)) {
+        needDefinition(enumType->getDecl());
+        return;
+      }
+      if (!typePtr->isSugared()) {
+        return;
+      }
+      type = type.getSingleStepDesugaredType(*context);
+    }
+  }
+
+  void useObjectType(const ObjCObjectType *objectType) {
+    if (ObjCInterfaceDecl *interface = objectType->getInterface()) {
+      useThroughPointer(interface, ("@class " + interface->getName() + ";").str());
+    }
+    for (ObjCProtocolDecl *protocol : objectType->getProtocols()) {
+      useThroughPointer(protocol, ("@protocol " + protocol->getName() + ";").str());
+    }
+    for (QualType typeArgument : objectType->getTypeArgsAsWritten()) {
+      useType(typeArgument, false);
+    }
+  }
+
+  void needDefinition(const Decl *declaration) {
+    NameID import = importOf(declaration);
+    if (import != InvalidName) {
+      tuContext.headerUses[import].needsDefinition = true;
+    }
+  }
+
+  void useThroughPointer(const Decl *declaration, std::string forwardDeclaration) {
+    NameID import = importOf(declaration);
+    if (import != InvalidName) {
+      tuContext.headerUses[import].forwardDeclarations.insert(std::move(forwardDeclaration));
+    }
+  }
+
+  // Classes and protocols belong to the import with their definition, a
+  // forward declaration may come from anywhere.
+  NameID importOf(const Decl *declaration) {
+    if (!declaration) {
+      return InvalidName;
+    }
+    if (auto *interface = dyn_cast<ObjCInterfaceDecl>(declaration)) {
+      if (const ObjCInterfaceDecl *definition = interface->getDefinition()) {
+        declaration = definition;
+      }
+    } else if (auto *protocol = dyn_cast<ObjCProtocolDecl>(declaration)) {
+      if (const ObjCProtocolDecl *definition = protocol->getDefinition()) {
+        declaration = definition;
+      }
+    } else if (auto *tag = dyn_cast<TagDecl>(declaration)) {
+      if (const TagDecl *definition = tag->getDefinition()) {
+        declaration = definition;
+      }
+    }
+    return classifier.importOf(declaration->getLocation());
+  }
+};
+
+class ObjcClassConsumer : public clang::ASTConsumer {
+public:
+  ObjcClassConsumer(CompilerInstance &compiler, TUContext &tuContext)
+    : classifier(compiler.getSourceManager(), tuContext), modules(compiler, tuContext),
+      visitor(&compiler.getASTContext(), tuContext, classifier, modules),
+      headerVisitor(&compiler.getASTContext(), tuContext, classifier), preprocessor(compiler.getPreprocessor()),
+      tuContext(tuContext) {
+      Preprocessor &PP = compiler.getPreprocessor();
+      PP.addPPCallbacks(llvm::make_unique<PPCallbacksTracker>(PP, tuContext, classifier));
+      if (tuContext.timeTrace) {
+        parseBegin = std::chrono::steady_clock::now();
+      }
+    }
+
+  virtual void HandleTranslationUnit(clang::ASTContext &context) {
+    const SourceManager& sourceManager = context.getSourceManager();
+    tuContext.mainFile = classifier.classify(sourceManager.getMainFileID()).name;
+    StringRef mainFileName = tuContext.mainFile != InvalidName ? tuContext.names.name(tuContext.mainFile) : StringRef();
+    // Lexing, parsing and semantic analysis, everything between creating the
+    // consumer and being handed the finished AST.
+    if (tuContext.timeTrace) {
+      tuContext.timeTrace->add("Parse", mainFileName, parseBegin, std::chrono::steady_clock::now());
+    }
+    if (sourceManager.getPreambleFileID().isValid()) {
+      tuContext.stats.preamblesUsed = 1;
+    }
+
+    PhaseTimer timer(phaseStats(tuContext), Phase::Traversal, tuContext.timeTrace, mainFileName);
+    uint64_t allocationsBefore = threadAllocationCount();
+    if (FullTraversal) {
+      visitor.TraverseDecl(context.getTranslationUnitDecl());
+    } else {
+      for (Decl *declaration : context.getTranslationUnitDecl()->decls()) {
+        visitor.TraverseTopLevelDecl(declaration);
+      }
+    }
+    visitor.resolveUsedDeclarations();
+    tuContext.collectionAllocations = threadAllocationCount() - allocationsBefore;
+    if (tuContext.headerSubject) {
+      for (Decl *declaration : context.getTranslationUnitDecl()->decls()) {
+        if (classifier.classify(sourceManager.getFileLoc(declaration->getLocStart())).kind == FileInfo::Main) {
+          headerVisitor.TraverseDecl(declaration);
+        }
+      }
+    }
+    if (sourceManager.getPreambleFileID().isValid()) {
+      addPreambleMacros();
+    }
+    modules.finish(preprocessor);
+  }
+private:
+  FileClassifier classifier;
+  ModuleExportCollector modules;
+  ObjcClassVisitor visitor;
+  HeaderUseVisitor headerVisitor;
+  Preprocessor &preprocessor;
+  TUContext &tuContext;
+  TimePoint parseBegin;
+
+  // MacroDefined isn't called for the macros a shared preamble brings in, look
+  // for the ones defined by headers the main file imports once parsing is done.
+  void addPreambleMacros() {
+    for (const auto &macro : preprocessor.macros()) {
+      for (const MacroDirective *directive = preprocessor.getLocalMacroDirectiveHistory(macro.first); directive; directive = directive->getPrevious()) {
+        if (!isa<DefMacroDirective>(directive)) {
+          continue;
+        }
+        Symbol symbol = {SymbolType::MacroDefinition, tuContext.names.intern(macro.first->getName())};
+        addSymbolIfIncludedByMain(tuContext, classifier.classify(directive->getLocation()), symbol);
+      }
+    }
+  }
+};
+
+class ObjcClassAction : public clang::ASTFrontendAction {
+public:
+  explicit ObjcClassAction(TUContext &tuContext) : tuContext(tuContext) {}
+
+  virtual std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
+    clang::CompilerInstance &compiler, llvm::StringRef inFile) {
+    return std::unique_ptr<clang::ASTConsumer>(
+        new ObjcClassConsumer(compiler, tuContext));
+  }
+
+  void EndSourceFileAction() override {
+    if (tuContext.recordDependencies) {
+      recordDependencies(getCompilerInstance());
+    }
+  }
+private:
+  TUContext &tuContext;
+
+  // Headers loaded from a preamble or a module aren't necessarily in the
+  // source manager, so the inputs of every loaded AST file are added as well.
+  // A module file is rebuilt when its headers change, but only by the next
+  // compile that imports it, so its headers are checked directly.
+  void recordDependencies(CompilerInstance &compiler) {
+    llvm::DenseSet<const FileEntry *> seen;
+    auto addDependency = [&](const FileEntry *fileEntry) {
+      if (!fileEntry || !seen.insert(fileEntry).second) {
+        return;
+      }
+      SmallString<256> path(fileEntry->getName());
+      compiler.getFileManager().getVirtualFileSystem()->makeAbsolute(path);
+      tuContext.dependencies.push_back(ResultCache::stampFile(path, static_cast<uint64_t>(fileEntry->getSize()),
+                                                              static_cast<int64_t>(fileEntry->getModificationTime())));
+    };
+
+    const SourceManager &sourceManager = compiler.getSourceManager();
+    for (auto iter = sourceManager.fileinfo_begin(); iter != sourceManager.fileinfo_end(); ++iter) {
+      addDependency(iter->first);
+    }
+    if (IntrusiveRefCntPtr<ASTReader> reader = compiler.getModuleManager()) {
+      for (serialization::ModuleFile &moduleFile : reader->getModuleManager()) {
+        // Preambles are temporary files, their inputs are what matters.
+        if (moduleFile.Kind != serialization::MK_Preamble) {
+          addDependency(moduleFile.File);
+        }
+        reader->visitInputFiles(moduleFile, /*IncludeSystem=*/true, /*Complain=*/false,
+                                [&](const serialization::InputFile &inputFile, bool isSystem) {
+                                  addDependency(inputFile.getFile());
+                                });
+      }
+    }
+  }
+};
+
+class ObjcClassActionFactory : public FrontendActionFactory {
+public:
+  ObjcClassActionFactory(TUContext &tuContext, PreambleCache *preambleCache, std::string flags)
+    : tuContext(tuContext), preambleCache(preambleCache), flags(std::move(flags)) {}
+
+  clang::FrontendAction *create() override {
+    return new ObjcClassAction(tuContext);
+  }
+
+  bool runInvocation(std::shared_ptr<CompilerInvocation> invocation, FileManager *files,
+                     std::shared_ptr<PCHContainerOperations> pchContainerOps,
+                     DiagnosticConsumer *diagnosticConsumer) override {
+    if (preambleCache) {
+      usePreamble(*invocation, files->getVirtualFileSystem(), pchContainerOps);
+    }
+    return FrontendActionFactory::runInvocation(std::move(invocation), files, std::move(pchContainerOps), diagnosticConsumer);
+  }
+private:
+  TUContext &tuContext;
+  PreambleCache *preambleCache;
+  std::string flags;
+
+  void usePreamble(CompilerInvocation &invocation, IntrusiveRefCntPtr<vfs::FileSystem> fileSystem,
+                   std::shared_ptr<PCHContainerOperations> pchContainerOps) {
+    const FrontendOptions &frontendOptions = invocation.getFrontendOpts();
+    if (frontendOptions.Inputs.size() != 1 || !frontendOptions.Inputs[0].isFile()) {
+      return;
+    }
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> mainBuffer = fileSystem->getBufferForFile(frontendOptions.Inputs[0].getFile());
+    if (!mainBuffer) {
+      return;
+    }
+    PreambleBounds bounds = ComputePreambleBounds(*invocation.getLangOpts(), mainBuffer->get(), 0);
+    if (bounds.Size == 0) {
+      return;
+    }
+    std::shared_ptr<PrecompiledPreamble> preamble = preambleCache->get(flags, invocation, **mainBuffer, bounds, fileSystem, std::move(pchContainerOps));
+    if (preamble && preamble->CanReuse(invocation, mainBuffer->get(), bounds, fileSystem.get())) {
+      // The preamble lives on disk, so the file system is left as it is.
+      preamble->AddImplicitPreamble(invocation, fileSystem, mainBuffer->get());
+    }
+  }
+};
+
+// ClangTool moves into each compile command's directory by setting the working
+// directory of its file system. The real file system does that with a
+// process-wide chdir, which races between workers, so each worker gets one of
+// these instead and keeps its working directory to itself.
+class WorkingDirectoryFileSystem : public vfs::FileSystem {
+public:
+  explicit WorkingDirectoryFileSystem(IntrusiveRefCntPtr<vfs::FileSystem> base) : base(std::move(base)) {
+    if (llvm::ErrorOr<std::string> currentDirectory = this->base->getCurrentWorkingDirectory()) {
+      workingDirectory = *currentDirectory;
+    }
+  }
+
+  llvm::ErrorOr<vfs::Status> status(const Twine &path) override {
+    return base->status(makeAbsolute(path));
+  }
+
+  llvm::ErrorOr<std::unique_ptr<vfs::File>> openFileForRead(const Twine &path) override {
+    return base->openFileForRead(makeAbsolute(path));
+  }
+
+  vfs::directory_iterator dir_begin(const Twine &directory, std::error_code &errorCode) override {
+    return base->dir_begin(makeAbsolute(directory), errorCode);
+  }
+
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override {
+    return workingDirectory;
+  }
+
+  std::error_code setCurrentWorkingDirectory(const Twine &path) override {
+    SmallString<256> absolutePath = makeAbsolute(path);
+    llvm::ErrorOr<vfs::Status> directoryStatus = base->status(absolutePath);
+    if (!directoryStatus) {
+      return directoryStatus.getError();
+    }
+    if (!directoryStatus->isDirectory()) {
+      return std::make_error_code(std::errc::not_a_directory);
+    }
+    workingDirectory = absolutePath.str();
+    return std::error_code();
+  }
+
+  std::error_code getRealPath(const Twine &path, SmallVectorImpl<char> &output) const override {
+    return base->getRealPath(makeAbsolute(path), output);
+  }
+
+private:
+  IntrusiveRefCntPtr<vfs::FileSystem> base;
+  std::string workingDirectory;
+
+  SmallString<256> makeAbsolute(const Twine &path) const {
+    SmallString<256> result;
+    path.toVector(result);
+    if (workingDirectory.empty() || llvm::sys::path::is_absolute(result)) {
+      return result;
+    }
+    SmallString<256> absolutePath(workingDirectory);
+    llvm::sys::path::append(absolutePath, result);
+    return absolutePath;
+  }
+};
+
+void printSymbols(const TUSymbols &tuSymbols, raw_ostream &out) {
+  const NameTable &names = tuSymbols.names;
+  for (auto &pair : tuSymbols.symbolsForFile) {
+    out << "File: " << names.name(pair.first) << "\n";
+    for (auto &entry : pair.second) {
+      const Symbol &symbol = entry.first;
+      if (!entry.second.empty()) {
+        for (NameID className : entry.second) {
+          out << symbolTypeToString(symbol.type) << ": " << names.name(className) << " " << names.name(symbol.name) << "\n";
+        }
+      } else {
+        out << symbolTypeToString(symbol.type) << ": " << names.name(symbol.name) << "\n";
+      }
+    }
+    out << "\n";
+  }
+
+  out << "\n" << "Modules:\n";
+  for (NameID module : tuSymbols.modulesImported) {
+    out << names.name(module) << "\n";
+  }
+
+  out << "\n" << "Used by declaration:\n";
+  for (NameID import : tuSymbols.usedImports) {
+    out << names.name(import) << "\n";
+  }
+  out << "\n";
+}
+
+void printDebug(const TUContext &tuContext, raw_ostream &out) {
+  printSymbols(tuContext, out);
+
+  out << "Traversed " << tuContext.stats.traversedDeclarations << " declarations and "
+      << tuContext.stats.traversedStatements << " statements\n\n";
+
+  out << "Unused Imports:\n";
+}
+
+// State shared by every TU of a run. Anything in here is used by several
+// workers at once and has to be thread safe.
+struct BatchContext {
+  explicit BatchContext(const CompilationDatabase &compilations)
+    : compilations(compilations), realFileSystem(new CountingFileSystem(vfs::getRealFileSystem())) {}
+
+  const CompilationDatabase &compilations;
+  IntrusiveRefCntPtr<CountingFileSystem> realFileSystem;
+  IntrusiveRefCntPtr<SharedFileCache> fileCache;
+  std::unique_ptr<PreambleCache> preambleCache;
+  std::unique_ptr<ResultCache> resultCache;
+  std::unique_ptr<SymbolDumpWriter> symbolDump;
+  std::unique_ptr<TimeTrace> timeTrace;
+  std::unique_ptr<ShardResultsWriter> shardOutput;
+  std::unique_ptr<ImportIndexWriter> importIndex;
+  ModuleExportIndex moduleIndex;
+  std::unique_ptr<ImportFixes> fixes;
+  std::unique_ptr<ResultEmitter> emitter;
+};
+
+// Everything that decides a TU's result before its headers are read: how it is
+// compiled and what its main file says.
+std::string resultCacheKey(const std::vector<CompileCommand> &commands, const std::string &file) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> mainFile = llvm::MemoryBuffer::getFile(file);
+  if (!mainFile || commands.empty()) {
+    return std::string();
+  }
+  std::string command;
+  for (const CompileCommand &compileCommand : commands) {
+    command += compileCommand.Directory;
+    for (const std::string &argument : compileCommand.CommandLine) {
+      command += '\0';
+      command += argument;
+    }
+    command += '\n';
+  }
+  return ResultCache::makeKey(command, (*mainFile)->getBuffer());
+}
+
+TUResult analyzeTranslationUnit(BatchContext &batch, const std::string &file) {
+  TUResult result;
+  result.file = file;
+  result.stats.translationUnits = 1;
+  bool timePhases = PrintStats || batch.timeTrace;
+
+  std::vector<CompileCommand> commands = batch.compilations.getCompileCommands(file);
+  std::string cacheKey;
+  // The cache only knows unused imports, not forward declarations.
+  if (batch.resultCache && !HeaderSubjects) {
+    PhaseTimer timer(timePhases ? &result.stats : nullptr, Phase::CacheLookup, batch.timeTrace.get(), file);
+    cacheKey = resultCacheKey(commands, file);
+    // Neither the debug output, the symbols, the import costs nor the imports
+    // that are used are cached, parse the TU if any of them is wanted.
+    if (!cacheKey.empty() && !DebugPrint && !batch.symbolDump && !ImportCosts && !batch.importIndex &&
+        batch.resultCache->lookup(cacheKey, result.status, result.unusedImports)) {
+      result.cached = true;
+      result.stats.resultsCached = 1;
+      return result;
+    }
+  }
+
+  TUContext tuContext;
+  tuContext.recordDependencies = !cacheKey.empty();
+  tuContext.timePhases = timePhases;
+  tuContext.timeTrace = batch.timeTrace.get();
+  tuContext.moduleIndex = FullTraversal ? nullptr : &batch.moduleIndex;
+  tuContext.measureImportCosts = ImportCosts;
+  tuContext.headerSubject = HeaderSubjects;
+  tuContext.recordAllImports = batch.importIndex != nullptr;
+  IntrusiveRefCntPtr<vfs::FileSystem> sharedFileSystem = batch.realFileSystem;
+  if (batch.fileCache) {
+    sharedFileSystem = batch.fileCache;
+  }
+  IntrusiveRefCntPtr<vfs::FileSystem> fileSystem(new WorkingDirectoryFileSystem(sharedFileSystem));
+  ClangTool tool(batch.compilations, file, std::make_shared<PCHContainerOperations>(), fileSystem);
+  // A file with several compile commands would need a key per command, only
+  // share preambles between files with exactly one. Headers in a preamble
+  // aren't read again, so import costs can't be measured with one.
+  PreambleCache *preambleCache = nullptr;
+  std::string flags;
+  if (batch.preambleCache && commands.size() == 1 && !ImportCosts) {
+    preambleCache = batch.preambleCache.get();
+    flags = flagsKey(commands.front());
+  }
+  ObjcClassActionFactory actionFactory(tuContext, preambleCache, std::move(flags));
+  {
+    PhaseTimer timer(phaseStats(tuContext), Phase::Frontend, tuContext.timeTrace, file);
+    result.status = tool.run(&actionFactory);
+  }
+  result.collectionAllocations = tuContext.collectionAllocations;
+  result.diagnostics = std::move(tuContext.diagnostics);
+  result.internedNames = tuContext.names.size();
+  result.nameTableBytes = tuContext.names.getMemorySize();
+
+  // The debug output and dumps list every module's symbols in the TU's names.
+  if (DebugPrint || batch.symbolDump) {
+    materializeIndexedModules(tuContext);
+  }
+  if (DebugPrint) {
+    llvm::raw_string_ostream debugStream(result.debugOutput);
+    printDebug(tuContext, debugStream);
+  }
+  {
+    PhaseTimer timer(phaseStats(tuContext), Phase::Matching, tuContext.timeTrace, file);
+    result.unusedImports = HeaderSubjects ? findReplaceableHeaderImports(tuContext, tuContext.headerUses)
+                                          : findUnusedImports(tuContext);
+  }
+  for (auto &unusedImport : result.unusedImports) {
+    NameID name = tuContext.names.find(unusedImport.name);
+    auto iter = name != InvalidName ? tuContext.importCosts.find(name) : tuContext.importCosts.end();
+    if (iter != tuContext.importCosts.end()) {
+      unusedImport.cost = iter->second;
+    }
+  }
+  result.stats.add(tuContext.stats);
+  if (batch.symbolDump) {
+    batch.symbolDump->add(file, result.status, tuContext);
+  }
+  if (batch.importIndex) {
+    batch.importIndex->add(file, result.status, tuContext, result.unusedImports);
+  }
+  // A failed compile may have missed headers that don't exist yet, try it
+  // again next time.
+  if (!cacheKey.empty() && result.status == 0) {
+    batch.resultCache->store(cacheKey, result.status, tuContext.dependencies, result.unusedImports);
+  }
+  return result;
+}
+
+// Rematches one TU of a dump, as if it had just been parsed.
+TUResult rematchTranslationUnit(const SymbolDump &dump, size_t index) {
+  TUResult result;
+  DumpedTU tu;
+  if (!dump.read(index, tu)) {
+    result.file = tu.file;
+    result.status = 1;
+    llvm::errs() << "error: corrupt symbols for translation unit " << index << " of a dump\n";
+    return result;
+  }
+  result.file = tu.file;
+  result.status = tu.status;
+  result.stats.translationUnits = 1;
+  result.internedNames = tu.symbols.names.size();
+  result.nameTableBytes = tu.symbols.names.getMemorySize();
+  if (DebugPrint) {
+    llvm::raw_string_ostream debugStream(result.debugOutput);
+    printSymbols(tu.symbols, debugStream);
+    debugStream << "Unused Imports:\n";
+  }
+  PhaseTimer timer(PrintStats ? &result.stats : nullptr, Phase::Matching);
+  result.unusedImports = findUnusedImports(tu.symbols);
+  return result;
+}
+
+// How many threads runJobs uses for `count` jobs.
+unsigned workerCount(size_t count, unsigned int jobs) {
+  if (jobs == 0) {
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return std::min<size_t>(jobs, count);
+}
+
+// Runs work(i) for every i below count, on up to `jobs` threads.
+void runJobs(size_t count, unsigned int jobs, std::function<void(size_t)> work) {
+  jobs = workerCount(count, jobs);
+  if (jobs <= 1) {
+    for (size_t i = 0; i < count; i++) {
+      work(i);
+    }
+    return;
+  }
+  llvm::ThreadPool pool(jobs);
+  for (size_t i = 0; i < count; i++) {
+    pool.async([&work, i]() {
+      work(i);
+    });
+  }
+  pool.wait();
+}
+
+void printImportCost(const ImportCost &cost) {
+  textOutput() << cost.bytes << " bytes, " << cost.tokens << " tokens, " << cost.files << " new files, "
+               << llvm::format("%.1f ms", cost.seconds * 1000);
+}
+
+// Every unused import of the run, the ones that add the most text first.
+void printImportCostRanking(const std::vector<TUResult> &results) {
+  std::vector<std::pair<const TUResult *, const UnusedImport *>> ranking;
+  for (auto &result : results) {
+    for (auto &unusedImport : result.unusedImports) {
+      ranking.push_back(std::make_pair(&result, &unusedImport));
+    }
+  }
+  std::stable_sort(ranking.begin(), ranking.end(), [](const std::pair<const TUResult *, const UnusedImport *> &lhs,
+                                                      const std::pair<const TUResult *, const UnusedImport *> &rhs) {
+    if (lhs.second->cost.bytes != rhs.second->cost.bytes) {
+      return lhs.second->cost.bytes > rhs.second->cost.bytes;
+    }
+    return lhs.second->cost.seconds > rhs.second->cost.seconds;
+  });
+  textOutput() << "Unused imports by cost:\n";
+  for (auto &entry : ranking) {
+    textOutput() << "  " << entry.first->file << ":" << entry.second->line << ": " << entry.second->name << " (";
+    printImportCost(entry.second->cost);
+    textOutput() << ")\n";
+  }
+}
+
+void printResult(const TUResult &result) {
+  textOutput() << result.diagnostics;
+  if (DebugPrint) {
+    textOutput() << result.debugOutput;
+  }
+  // Other formats have their findings streamed by the ResultEmitter.
+  for (auto &unusedImport : result.unusedImports) {
+    if (Format != OutputFormat::Text) {
+      break;
+    }
+    if (unusedImport.forwardDeclarations.empty()) {
+      textOutput() << result.file << ":" << unusedImport.line << ": warning: Unused import " << unusedImport.name;
+    } else {
+      textOutput() << result.file << ":" << unusedImport.line << ": warning: Import " << unusedImport.name
+                   << " is only used through pointers, forward declare";
+      for (const std::string &forwardDeclaration : unusedImport.forwardDeclarations) {
+        textOutput() << " " << forwardDeclaration;
+      }
+      textOutput() << " and import it in the implementation";
+    }
+    if (ImportCosts) {
+      textOutput() << " (";
+      printImportCost(unusedImport.cost);
+      textOutput() << ")";
+    }
+    textOutput() << "\n";
+  }
+  if (AllocStats && !result.cached) {
+    textOutput() << result.file << ": " << result.collectionAllocations << " allocations while collecting symbols, "
+                 << result.internedNames << " names interned in " << result.nameTableBytes << " bytes\n";
+  }
+  if (PrintStats) {
+    textOutput() << "Stats for " << result.file << ":\n";
+    result.stats.print(textOutput());
+  }
+}
+
+// Prints every result in file order regardless of which worker finished
+// first, and returns the worst status.
+int reportResults(std::vector<TUResult> &results) {
+  std::stable_sort(results.begin(), results.end(), [](const TUResult &lhs, const TUResult &rhs) {
+    return lhs.file < rhs.file;
+  });
+
+  int status = 0;
+  for (auto &result : results) {
+    printResult(result);
+    status = std::max(status, result.status);
+  }
+  if (ImportCosts && Format == OutputFormat::Text) {
+    printImportCostRanking(results);
+  }
+
+  if (PrintStats) {
+    TUStats total;
+    for (auto &result : results) {
+      total.add(result.stats);
+    }
+    textOutput() << "Stats for all " << total.translationUnits << " translation units:\n";
+    total.print(textOutput());
+    textOutput() << llvm::format("  Peak resident memory: %.1f MB\n", getPeakResidentBytes() / 1048576.0);
+  }
+  return status;
+}
+
+void setUpOutputs(BatchContext &batch) {
+  if (Format != OutputFormat::Text) {
+    batch.emitter = llvm::make_unique<ResultEmitter>(Format, llvm::outs(), ImportCosts);
+  }
+  // Shards leave the fixes to --merge-shards, which would apply them again.
+  if ((Fix || !ExportFixesPath.empty()) && !Serve && ShardSpec.empty()) {
+    batch.fixes = llvm::make_unique<ImportFixes>();
+  }
+}
+
+// Hands a finished TU to the fixes and the emitter. Once streamed, only what
+// the summary needs is kept.
+void finishResult(BatchContext &batch, TUResult &result) {
+  if (batch.fixes) {
+    batch.fixes->add(result.file, result.unusedImports);
+  }
+  if (batch.emitter) {
+    batch.emitter->emit(result.file, result.status, result.cached, result.unusedImports);
+    std::vector<UnusedImport>().swap(result.unusedImports);
+  }
+}
+
+// Fixes are written after every TU is analyzed, so no TU sees a file another
+// one has already changed.
+int writeFixes(ImportFixes &fixes) {
+  int status = 0;
+  if (!ExportFixesPath.empty()) {
+    if (std::error_code error = fixes.exportYAML(ExportFixesPath)) {
+      llvm::errs() << "error: could not write " << ExportFixesPath << ": " << error.message() << "\n";
+      status = 1;
+    }
+  }
+  if (Fix && !fixes.apply(llvm::errs())) {
+    status = 1;
+  }
+  llvm::errs() << (Fix ? "Removed " : "Exported ") << fixes.getFixCount() << " imports from " << fixes.getFileCount() << " files";
+  if (fixes.getSkippedCount()) {
+    llvm::errs() << ", skipped " << fixes.getSkippedCount() << " that aren't a plain import line";
+  }
+  if (fixes.getConflictCount()) {
+    llvm::errs() << ", dropped " << fixes.getConflictCount() << " conflicting";
+  }
+  llvm::errs() << "\n";
+  return status;
+}
+
+int finishOutputs(BatchContext &batch) {
+  int status = 0;
+  if (batch.emitter) {
+    batch.emitter->finish();
+  }
+  if (batch.fixes) {
+    status = writeFixes(*batch.fixes);
+  }
+  return status;
+}
+
+// Answers requests read from stdin until it is closed or says "quit", one per
+// line:
+//   analyze <file>
+// The answer is the file's warnings, as in a batch run, followed by
+// "done <status> <milliseconds>", or a "done" record with JSON Lines. The
+// compilation database, the caches in `batch` and the process itself stay warm
+// between requests.
+int serve(BatchContext &batch) {
+  std::vector<double> latencies;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    StringRef request = StringRef(line).trim();
+    if (request.empty()) {
+      continue;
+    }
+    if (request == "quit") {
+      break;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int status = 1;
+    if (request.startswith("analyze ")) {
+      TUResult result = analyzeTranslationUnit(batch, request.drop_front(strlen("analyze ")).trim().str());
+      printResult(result);
+      if (batch.emitter) {
+        batch.emitter->emit(result.file, result.status, result.cached, result.unusedImports);
+      }
+      status = result.status;
+    } else {
+      std::string message = ("unknown request '" + request + "'").str();
+      if (!batch.emitter || !batch.emitter->emitRequestError(message)) {
+        textOutput() << "error: " << message << "\n";
+      }
+    }
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    latencies.push_back(milliseconds);
+    if (!batch.emitter || !batch.emitter->emitRequestDone(status, milliseconds)) {
+      textOutput() << "done " << status << " " << llvm::format("%.1f", milliseconds) << "\n";
+    }
+    textOutput().flush();
+  }
+
+  // The first request pays for the cold caches, the rest show what a warm
+  // request costs.
+  if (latencies.size() > 1) {
+    std::vector<double> warm(latencies.begin() + 1, latencies.end());
+    std::sort(warm.begin(), warm.end());
+    llvm::errs() << llvm::format("Served %zu requests: first %.1f ms, warm median %.1f ms, warm max %.1f ms, peak resident memory %.1f MB\n",
+                           latencies.size(), latencies.front(), warm[warm.size() / 2], warm.back(),
+                           getPeakResidentBytes() / 1048576.0);
+  }
+  return 0;
+}
+
+int rematch() {
+  std::vector<std::unique_ptr<SymbolDump>> dumps;
+  std::vector<std::pair<const SymbolDump *, size_t>> units;
+  for (const std::string &path : RematchPaths) {
+    std::string error;
+    std::unique_ptr<SymbolDump> dump = SymbolDump::open(path, error);
+    if (!dump) {
+      llvm::errs() << "error: could not read " << path << ": " << error << "\n";
+      return 1;
+    }
+    for (size_t i = 0; i < dump->size(); i++) {
+      units.push_back(std::make_pair(dump.get(), i));
+    }
+    dumps.push_back(std::move(dump));
+  }
+
+  std::vector<TUResult> results(units.size());
+  runJobs(units.size(), Jobs, [&units, &results](size_t i) {
+    results[i] = rematchTranslationUnit(*units[i].first, units[i].second);
+  });
+  return reportResults(results);
+}
+
+// Reports the results of every shard of a run as if it had been a single one.
+// Fixes and streamed results come out here rather than in the shards, in file
+// order. Their files must be where the shards saw them.
+int mergeShards() {
+  std::vector<TUResult> results;
+  std::vector<bool> seen;
+  unsigned shardCount = 0;
+  for (const std::string &path : MergeShardPaths) {
+    ShardResults shard;
+    std::string error;
+    if (!readShardResults(path, shard, error)) {
+      llvm::errs() << "error: could not read " << path << ": " << error << "\n";
+      return 1;
+    }
+    if (shardCount == 0) {
+      shardCount = shard.count;
+      seen.resize(shardCount);
+    }
+    if (shard.count != shardCount || shard.index == 0 || shard.index > shardCount || seen[shard.index - 1]) {
+      llvm::errs() << "error: " << path << " is shard " << shard.index << "/" << shard.count
+                   << ", which doesn't fit the other shards\n";
+      return 1;
+    }
+    seen[shard.index - 1] = true;
+    std::move(shard.results.begin(), shard.results.end(), std::back_inserter(results));
+  }
+  for (unsigned i = 0; i < shardCount; i++) {
+    if (!seen[i]) {
+      llvm::errs() << "error: shard " << i + 1 << "/" << shardCount << " is missing\n";
+      return 1;
+    }
+  }
+
+  FixedCompilationDatabase noCompilations(".", std::vector<std::string>());
+  BatchContext batch(noCompilations);
+  setUpOutputs(batch);
+  std::stable_sort(results.begin(), results.end(), [](const TUResult &lhs, const TUResult &rhs) {
+    return lhs.file < rhs.file;
+  });
+  for (TUResult &result : results) {
+    finishResult(batch, result);
+  }
+  int status = reportResults(results);
+  return std::max(status, finishOutputs(batch));
+}
+
+// Lists the TUs importing each queried header or module, and whether they
+// use it, or without queries every import with its counts.
+int queryIndex() {
+  std::vector<std::unique_ptr<ImportIndex>> indexes;
+  for (const std::string &path : QueryIndexPaths) {
+    std::string error;
+    std::unique_ptr<ImportIndex> index = ImportIndex::open(path, error);
+    if (!index) {
+      llvm::errs() << "error: could not read " << path << ": " << error << "\n";
+      return 1;
+    }
+    indexes.push_back(std::move(index));
+  }
+
+  llvm::raw_ostream &out = llvm::outs();
+  if (QueryImports.empty()) {
+    // Shards of one run each write an index, an import can be in several.
+    std::map<llvm::StringRef, std::pair<unsigned, unsigned>> counts;
+    for (auto &index : indexes) {
+      for (size_t i = 0; i < index->getImportCount(); i++) {
+        unsigned importers;
+        unsigned users;
+        index->countsAt(i, importers, users);
+        std::pair<unsigned, unsigned> &count = counts[index->importAt(i)];
+        count.first += importers;
+        count.second += users;
+      }
+    }
+    for (auto &count : counts) {
+      out << count.first << ": imported by " << count.second.first << ", used by " << count.second.second << "\n";
+    }
+    return 0;
+  }
+
+  for (const std::string &query : QueryImports) {
+    std::map<llvm::StringRef, std::vector<ImportReference>> matches;
+    for (auto &index : indexes) {
+      for (size_t position : index->find(query)) {
+        std::vector<ImportReference> references = index->referencesAt(position);
+        std::vector<ImportReference> &match = matches[index->importAt(position)];
+        match.insert(match.end(), references.begin(), references.end());
+      }
+    }
+    if (matches.empty()) {
+      out << query << ": not imported by any translation unit\n";
+    }
+    for (auto &match : matches) {
+      std::stable_sort(match.second.begin(), match.second.end(), [](const ImportReference &lhs, const ImportReference &rhs) {
+        return lhs.file < rhs.file;
+      });
+      unsigned users = std::count_if(match.second.begin(), match.second.end(), [](const ImportReference &reference) {
+        return reference.used;
+      });
+      out << match.first << ": imported by " << match.second.size() << ", used by " << users << "\n";
+      for (const ImportReference &reference : match.second) {
+        out << "  " << reference.file << ":" << reference.line << ": " << (reference.used ? "used" : "unused");
+        if (reference.failed) {
+          out << " (failed to compile)";
+        }
+        out << "\n";
+      }
+    }
+  }
+  return 0;
+}
+
+// Finds the compilation database the way CommonOptionsParser does: the
+// command after `--`, the one in -p, or the one above the first source file.
+// Without any of them, source files are compiled without flags and `--all`
+// looks in the current directory.
+std::unique_ptr<CompilationDatabase> loadCompilations(std::unique_ptr<CompilationDatabase> commandLineCompilations,
+                                                      std::string &errorMessage) {
+  std::unique_ptr<CompilationDatabase> compilations = std::move(commandLineCompilations);
+  if (!compilations && !BuildPath.empty()) {
+    compilations = CompilationDatabase::autoDetectFromDirectory(BuildPath, errorMessage);
+  } else if (!compilations && !SourcePaths.empty()) {
+    compilations = CompilationDatabase::autoDetectFromSource(SourcePaths.front(), errorMessage);
+    if (!compilations) {
+      llvm::errs() << "warning: " << errorMessage << ", running without flags\n";
+      compilations = llvm::make_unique<FixedCompilationDatabase>(".", std::vector<std::string>());
+    }
+  } else if (!compilations) {
+    compilations = CompilationDatabase::autoDetectFromDirectory(".", errorMessage);
+  }
+  if (!compilations) {
+    return nullptr;
+  }
+  auto adjustingCompilations = llvm::make_unique<ArgumentsAdjustingCompilations>(std::move(compilations));
+  adjustingCompilations->appendArgumentsAdjuster(getInsertArgumentAdjuster(ArgsBefore, ArgumentInsertPosition::BEGIN));
+  adjustingCompilations->appendArgumentsAdjuster(getInsertArgumentAdjuster(ArgsAfter, ArgumentInsertPosition::END));
+  return std::move(adjustingCompilations);
+}
+
+int main(int argc, const char **argv) {
+  // Takes everything after `--` off the command line.
+  std::string commandLineError;
+  std::unique_ptr<CompilationDatabase> commandLineCompilations =
+      FixedCompilationDatabase::loadFromCommandLine(argc, argv, commandLineError);
+  cl::HideUnrelatedOptions(toolCategory);
+  cl::ParseCommandLineOptions(argc, argv);
+  if (!RematchPaths.empty()) {
+    return rematch();
+  }
+  if (!MergeShardPaths.empty()) {
+    return mergeShards();
+  }
+  if (!QueryIndexPaths.empty()) {
+    return queryIndex();
+  }
+
+  std::string errorMessage;
+  std::unique_ptr<CompilationDatabase> loadedCompilations = loadCompilations(std::move(commandLineCompilations), errorMessage);
+  if (!loadedCompilations) {
+    llvm::errs() << "error: " << errorMessage << "\n";
+    return 1;
+  }
+  // Indexing the source files by directory only pays off for headers.
+  std::unique_ptr<HeaderCommandsDatabase> headerCompilations;
+  if (HeaderSubjects) {
+    headerCompilations = llvm::make_unique<HeaderCommandsDatabase>(*loadedCompilations);
+  }
+  const CompilationDatabase &compilations =
+    headerCompilations ? static_cast<const CompilationDatabase &>(*headerCompilations) : *loadedCompilations;
+
+  std::vector<std::string> files = AnalyzeAll ? compilations.getAllFiles() : std::vector<std::string>(SourcePaths.begin(), SourcePaths.end());
+  if (HeaderSubjects && AnalyzeAll) {
+    files = headersOfSourceFiles(files);
+  }
+  unsigned shardIndex = 0;
+  unsigned shardCount = 0;
+  if (!ShardSpec.empty()) {
+    if (!parseShardSpec(ShardSpec, shardIndex, shardCount)) {
+      llvm::errs() << "error: --shard takes i/n with 1 <= i <= n, not " << ShardSpec << "\n";
+      return 1;
+    }
+    if (ShardOutputPath.empty() || Serve) {
+      llvm::errs() << "error: --shard needs --shard-output and can't be used with --serve\n";
+      return 1;
+    }
+    files = filesOfShard(files, shardIndex, shardCount);
+  }
+  if (!WriteIndexPath.empty() && Serve) {
+    llvm::errs() << "error: --write-index can't be used with --serve\n";
+    return 1;
+  }
+  if (files.empty() && !Serve) {
+    llvm::errs() << "error: no input files, pass source files or --all\n";
+    return 1;
+  }
+
+  BatchContext batch(compilations);
+  // A server sees the same files over and over, their preambles are always
+  // worth keeping.
+  if (SharePreambles || Serve) {
+    batch.preambleCache = llvm::make_unique<PreambleCache>();
+  }
+  if (!ResultCachePath.empty()) {
+    batch.resultCache = llvm::make_unique<ResultCache>(ResultCachePath);
+  }
+  if (!DumpSymbolsPath.empty()) {
+    std::error_code error;
+    batch.symbolDump = llvm::make_unique<SymbolDumpWriter>(DumpSymbolsPath, error);
+    if (error) {
+      llvm::errs() << "error: could not write " << DumpSymbolsPath << ": " << error.message() << "\n";
+      return 1;
+    }
+  }
+
+  if (!TimeTracePath.empty()) {
+    batch.timeTrace = llvm::make_unique<TimeTrace>();
+  }
+  // Files change between the requests of a server.
+  if (FileCache && !Serve) {
+    batch.fileCache = new SharedFileCache(batch.realFileSystem);
+  }
+  if (shardCount) {
+    std::error_code error;
+    batch.shardOutput = llvm::make_unique<ShardResultsWriter>(ShardOutputPath, shardIndex, shardCount, error);
+    if (error) {
+      llvm::errs() << "error: could not write " << ShardOutputPath << ": " << error.message() << "\n";
+      return 1;
+    }
+  }
+  if (!WriteIndexPath.empty()) {
+    batch.importIndex = llvm::make_unique<ImportIndexWriter>(WriteIndexPath);
+  }
+  setUpOutputs(batch);
+
+  int status;
+  if (Serve) {
+    status = serve(batch);
+  } else {
+    std::unique_ptr<ScheduleHistory> history;
+    if (!ScheduleHistoryPath.empty()) {
+      history = llvm::make_unique<ScheduleHistory>(ScheduleHistoryPath);
+    }
+    // A TU without a single import has nothing to report. The debug output
+    // and dumps list its symbols all the same, so it is parsed for them.
+    std::vector<uint64_t> importCounts;
+    size_t prefiltered = 0;
+    if (Prefilter && !DebugPrint && !batch.symbolDump) {
+      importCounts.resize(files.size());
+      runJobs(files.size(), Jobs, [&files, &importCounts](size_t i) {
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = llvm::MemoryBuffer::getFile(files[i], -1, false);
+        // Files that can't be read are left for the compiler to report.
+        importCounts[i] = buffer ? scanImports((*buffer)->getBuffer()).size() : 1;
+      });
+      prefiltered = std::count(importCounts.begin(), importCounts.end(), 0);
+    }
+    // Results end up in file order whatever order the TUs run in. Imports
+    // predict a TU's cost better than its size does.
+    std::vector<size_t> order = scheduleByCost(files, history.get(), importCounts);
+    RunTimeline timeline(files.size());
+    std::vector<TUResult> results(files.size());
+    runJobs(files.size(), Jobs, [&batch, &files, &results, &importCounts, &order, &history, &timeline](size_t job) {
+      size_t i = order[job];
+      TimePoint begin = std::chrono::steady_clock::now();
+      bool parsed = false;
+      if (!importCounts.empty() && importCounts[i] == 0) {
+        results[i].file = files[i];
+        results[i].stats.translationUnits = 1;
+      } else {
+        results[i] = analyzeTranslationUnit(batch, files[i]);
+        parsed = !results[i].cached;
+      }
+      TimePoint end = std::chrono::steady_clock::now();
+      timeline.record(i, begin, end);
+      if (history && parsed) {
+        history->record(files[i], std::chrono::duration<double>(end - begin).count());
+      }
+      if (PrintStats) {
+        results[i].stats.residentBytes = getCurrentResidentBytes();
+      }
+      if (batch.shardOutput) {
+        batch.shardOutput->add(results[i]);
+      }
+      finishResult(batch, results[i]);
+    });
+    status = reportResults(results);
+    if (PrintStats || history) {
+      timeline.print(textOutput(), workerCount(files.size(), Jobs));
+    }
+    if (PrintStats && !importCounts.empty()) {
+      textOutput() << "Prefilter: skipped " << prefiltered << " of " << files.size()
+                   << " translation units without imports\n";
+    }
+    if (history) {
+      if (std::error_code error = history->save()) {
+        llvm::errs() << "warning: could not write " << ScheduleHistoryPath << ": " << error.message() << "\n";
+      }
+    }
+  }
+  status = std::max(status, finishOutputs(batch));
+  if (batch.shardOutput) {
+    if (std::error_code error = batch.shardOutput->close()) {
+      llvm::errs() << "error: could not write " << ShardOutputPath << ": " << error.message() << "\n";
+      status = std::max(status, 1);
+    }
+  }
+  if (batch.importIndex) {
+    if (std::error_code error = batch.importIndex->save()) {
+      llvm::errs() << "error: could not write " << WriteIndexPath << ": " << error.message() << "\n";
+      status = std::max(status, 1);
+    }
+  }
+  if (batch.resultCache) {
+    if (std::error_code error = batch.resultCache->save()) {
+      llvm::errs() << "warning: could not write " << ResultCachePath << ": " << error.message() << "\n";
+    }
+  }
+  if (batch.symbolDump) {
+    if (std::error_code error = batch.symbolDump->close()) {
+      llvm::errs() << "error: could not write " << DumpSymbolsPath << ": " << error.message() << "\n";
+      status = std::max(status, 1);
+    }
+  }
+  if (PrintStats) {
+    batch.realFileSystem->print(textOutput());
+    if (batch.fileCache) {
+      batch.fileCache->print(textOutput());
+    }
+  }
+  if ((DebugPrint || PrintStats) && batch.preambleCache) {
+    textOutput() << "Preambles: " << batch.preambleCache->getBuiltCount() << " built, "
+                 << batch.preambleCache->getReusedCount() << " reused\n";
+  }
+  if (PrintStats && batch.resultCache) {
+    textOutput() << "Result cache: " << batch.resultCache->getHitCount() << " hits, "
+                 << batch.resultCache->getMissCount() << " misses\n";
+  }
+  if (batch.timeTrace) {
+    if (std::error_code error = batch.timeTrace->write(TimeTracePath)) {
+      llvm::errs() << "warning: could not write " << TimeTracePath << ": " << error.message() << "\n";
+    }
+  }
+
+  return status;
+}
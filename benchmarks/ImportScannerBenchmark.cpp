@@ -0,0 +1,104 @@
+// Throughput of the raw import scanner behind --prefilter, over a synthetic
+// corpus of Objective-C source files: license headers, import blocks, and
+// method bodies full of comments and string literals.
+
+#include "ImportScanner.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<unsigned> FileCount("files",
+  cl::desc("Number of source files in the corpus"), cl::init(2000));
+static cl::opt<unsigned> MethodsPerFile("methods",
+  cl::desc("Methods in each file"), cl::init(60));
+static cl::opt<unsigned> ImportsPerFile("imports",
+  cl::desc("Imports at the top of each file"), cl::init(25));
+static cl::opt<unsigned> Repetitions("repetitions",
+  cl::desc("Scans of the corpus, the fastest is reported"), cl::init(5));
+static cl::opt<unsigned> Seed("seed",
+  cl::desc("Seed for the synthetic corpus"), cl::init(1));
+
+namespace {
+
+std::string makeSourceFile(std::mt19937 &random, unsigned index) {
+  std::string source =
+    "//\n"
+    "//  Generated" + std::to_string(index) + ".m\n"
+    "//\n"
+    "//  Copyright (c) Example. All rights reserved.\n"
+    "//\n\n";
+  for (unsigned i = 0; i < ImportsPerFile; i++) {
+    switch (random() % 4) {
+    case 0:
+      source += "#import <Framework" + std::to_string(random() % 50) + "/Framework.h>\n";
+      break;
+    case 1:
+      source += "@import Module" + std::to_string(random() % 50) + ";\n";
+      break;
+    default:
+      source += "#import \"Header" + std::to_string(random() % 5000) + ".h\"\n";
+      break;
+    }
+  }
+  source += "// #import \"Disabled.h\"\n\n@implementation Generated" + std::to_string(index) + "\n\n";
+  for (unsigned i = 0; i < MethodsPerFile; i++) {
+    source +=
+      "/**\n"
+      " * Loads the item at the given index, see #import for details.\n"
+      " */\n"
+      "- (void)method" + std::to_string(i) + ":(NSInteger)index {\n"
+      "  NSString *key = @\"com.example.key." + std::to_string(random()) + "\";\n"
+      "  if (index > " + std::to_string(random() % 1000) + ") {\n"
+      "    [self.items addObject:[NSString stringWithFormat:@\"%@ #%ld\", key, (long)index]]; // count\n"
+      "  }\n"
+      "  char separator = '/';\n"
+      "  self.counter += index * 2 / 3;\n"
+      "}\n\n";
+  }
+  return source + "@end\n";
+}
+
+} // end anonymous namespace
+
+// Keeps results alive so the optimizer can't drop the work being timed.
+static volatile uint64_t sink;
+
+int main(int argc, const char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "objc-unused-imports import scanner benchmark\n");
+
+  std::mt19937 random(Seed);
+  std::vector<std::string> corpus;
+  uint64_t bytes = 0;
+  for (unsigned i = 0; i < FileCount; i++) {
+    corpus.push_back(makeSourceFile(random, i));
+    bytes += corpus.back().size();
+  }
+
+  double best = 0;
+  uint64_t imports = 0;
+  for (unsigned i = 0; i < std::max(1u, unsigned(Repetitions)); i++) {
+    auto start = std::chrono::steady_clock::now();
+    imports = 0;
+    for (const std::string &source : corpus) {
+      imports += scanImports(source).size();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (i == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  sink = imports;
+
+  outs() << corpus.size() << " files, " << format("%.1f MB", bytes / 1048576.0) << ", " << imports << " imports\n";
+  outs() << format("scanImports %10.2f GB/s %10.2f ms\n", bytes / best / 1e9, best * 1e3);
+  return 0;
+}
@@ -0,0 +1,380 @@
+// Microbenchmarks for the symbol containers and the matching engine. The
+// symbol sets are synthetic, shaped like a large iOS app: thousands of
+// headers, deep class hierarchies and selectors that many classes declare.
+// Nothing is parsed, so this runs anywhere LLVM's support library builds.
+
+#include "AllocationCounter.h"
+#include "Matching.h"
+#include "SymbolTable.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<unsigned> HeaderCount("headers",
+  cl::desc("Number of imported headers"), cl::init(4000));
+static cl::opt<unsigned> SymbolsPerHeader("symbols-per-header",
+  cl::desc("Declarations in each header"), cl::init(60));
+static cl::opt<unsigned> ClassCount("classes",
+  cl::desc("Number of classes"), cl::init(20000));
+static cl::opt<unsigned> HierarchyDepth("depth",
+  cl::desc("Depth of the deepest class hierarchy"), cl::init(40));
+static cl::opt<unsigned> SelectorCount("selectors",
+  cl::desc("Number of distinct selectors"), cl::init(5000));
+static cl::opt<unsigned> MainFileUsages("usages",
+  cl::desc("Symbols the main file uses"), cl::init(3000));
+static cl::opt<unsigned> Repetitions("repetitions",
+  cl::desc("Runs of each benchmark, the fastest is reported"), cl::init(5));
+static cl::opt<unsigned> Seed("seed",
+  cl::desc("Seed for the synthetic symbol sets"), cl::init(1));
+
+namespace {
+
+// A TU the size of a large app's biggest files, kept as the flat lists each
+// benchmark replays.
+struct SyntheticTU {
+  TUSymbols symbols;
+  std::vector<NameID> classes;
+  // Declarations of each header, in the order the visitor would insert them.
+  std::vector<std::vector<std::pair<Symbol, NameID>>> headerSymbols;
+  std::vector<NameID> headers;
+};
+
+SyntheticTU makeSyntheticTU(std::mt19937 &random) {
+  SyntheticTU tu;
+  NameTable &names = tu.symbols.names;
+  tu.symbols.mainFile = names.intern("Main.m");
+
+  // Classes form chains up to HierarchyDepth deep below NSObject, so the
+  // hierarchy has both wide and deep subtrees.
+  NameID root = names.intern("NSObject");
+  tu.classes.push_back(root);
+  for (unsigned i = 1; i < ClassCount; i++) {
+    NameID name = names.intern("Class" + std::to_string(i));
+    NameID superClass = (i % HierarchyDepth == 1) ? root : tu.classes.back();
+    if (random() % 4 == 0) {
+      superClass = tu.classes[random() % tu.classes.size()];
+    }
+    tu.symbols.superClass[name] = superClass;
+    tu.classes.push_back(name);
+  }
+
+  // A few selectors (init, count, setDelegate:) are declared by hundreds of
+  // classes, most by one or two.
+  std::vector<NameID> selectors;
+  for (unsigned i = 0; i < SelectorCount; i++) {
+    selectors.push_back(names.intern("selector" + std::to_string(i) + ":withObject:"));
+  }
+  std::geometric_distribution<unsigned> popularSelector(0.01);
+  auto randomSelector = [&]() {
+    return selectors[std::min<unsigned>(popularSelector(random), SelectorCount - 1)];
+  };
+
+  static const SymbolType declarationKinds[] = {
+    SymbolType::MethodDeclaration, SymbolType::MethodDeclaration, SymbolType::MethodDeclaration,
+    SymbolType::PropertyDeclaration, SymbolType::FunctionDeclaration, SymbolType::TypedefDeclaration,
+    SymbolType::EnumConstantDeclaration, SymbolType::MacroDefinition, SymbolType::ClassDeclaration,
+    SymbolType::ProtocolConformanceDeclaration,
+  };
+  const unsigned kindCount = sizeof(declarationKinds) / sizeof(declarationKinds[0]);
+
+  for (unsigned i = 0; i < HeaderCount; i++) {
+    tu.headers.push_back(names.intern("/Project/Sources/Header" + std::to_string(i) + ".h"));
+    tu.symbols.lineNumbers[tu.headers.back()] = i + 1;
+    std::vector<std::pair<Symbol, NameID>> declarations;
+    NameID headerClass = tu.classes[random() % tu.classes.size()];
+    for (unsigned j = 0; j < SymbolsPerHeader; j++) {
+      SymbolType kind = declarationKinds[random() % kindCount];
+      switch (kind) {
+        case SymbolType::MethodDeclaration:
+        case SymbolType::PropertyDeclaration:
+        case SymbolType::ProtocolConformanceDeclaration:
+          declarations.push_back(std::make_pair(Symbol{kind, randomSelector()}, headerClass));
+          break;
+        case SymbolType::ClassDeclaration:
+          declarations.push_back(std::make_pair(Symbol{kind, headerClass}, InvalidName));
+          break;
+        default:
+          declarations.push_back(std::make_pair(
+            Symbol{kind, names.intern("symbol" + std::to_string(i) + "_" + std::to_string(j))}, InvalidName));
+          break;
+      }
+    }
+    tu.headerSymbols.push_back(std::move(declarations));
+  }
+
+  // The main file calls popular selectors on a mix of concrete receivers and
+  // id, and uses some of the free-standing declarations, which marks the
+  // header declaring them as used.
+  NameID idName = names.intern("id");
+  SymbolSet &mainSymbols = tu.symbols.symbolsForFile[tu.symbols.mainFile];
+  for (unsigned i = 0; i < MainFileUsages; i++) {
+    unsigned choice = random() % 3;
+    if (choice == 0) {
+      NameID receiver = random() % 10 == 0 ? idName : tu.classes[random() % tu.classes.size()];
+      insertSymbol(mainSymbols, Symbol{SymbolType::Method, randomSelector()}, receiver);
+    } else if (choice == 1) {
+      insertSymbol(mainSymbols, Symbol{SymbolType::Class, tu.classes[random() % tu.classes.size()]});
+    } else {
+      size_t header = random() % tu.headerSymbols.size();
+      const auto &declarations = tu.headerSymbols[header];
+      const Symbol &declaration = declarations[random() % declarations.size()].first;
+      if (declaration.type == SymbolType::FunctionDeclaration) {
+        tu.symbols.usedImports.insert(tu.headers[header]);
+      }
+    }
+  }
+  return tu;
+}
+
+// Runs `body` Repetitions times and returns the fastest run in nanoseconds.
+double timeBest(const std::function<void()> &body) {
+  double best = 0;
+  for (unsigned i = 0; i < std::max(1u, unsigned(Repetitions)); i++) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (i == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+void report(StringRef name, double nanoseconds, uint64_t operations) {
+  outs() << format("%-22s %10.2f ns/op %12llu ops %10.2f ms\n", name.str().c_str(),
+                   nanoseconds / std::max<uint64_t>(1, operations),
+                   static_cast<unsigned long long>(operations), nanoseconds / 1e6);
+}
+
+void reportMemory(StringRef name, size_t bytes) {
+  outs() << format("  %-20s %12zu bytes\n", name.str().c_str(), bytes);
+}
+
+size_t symbolSetMemory(const SymbolSet &set) {
+  size_t bytes = set.getMemorySize();
+  for (auto &entry : set) {
+    // Lists longer than the inline capacity live on the heap.
+    if (entry.second.capacity() > 2) {
+      bytes += entry.second.capacity() * sizeof(NameID);
+    }
+  }
+  return bytes;
+}
+
+// Symbol storage as it was before names were interned: a std::string per
+// symbol and a heap-allocated set of class names for each class-qualified
+// one. Kept to count the allocations interning saves.
+struct LegacySymbol {
+  SymbolType type;
+  std::string value;
+  std::unordered_set<std::string> *classNames = nullptr;
+
+  bool operator==(const LegacySymbol &other) const {
+    return type == other.type && value == other.value;
+  }
+};
+
+struct LegacySymbolHash {
+  size_t operator()(const LegacySymbol &symbol) const {
+    return (std::hash<std::string>()(symbol.value) << 8) | static_cast<size_t>(symbol.type);
+  }
+};
+
+typedef std::unordered_set<LegacySymbol, LegacySymbolHash> LegacySymbolSet;
+
+void insertLegacySymbol(LegacySymbolSet &set, LegacySymbol symbol, const std::string &className) {
+  if (className.empty()) {
+    set.insert(symbol);
+    return;
+  }
+  auto iter = set.find(symbol);
+  if (iter == set.end()) {
+    symbol.classNames = new std::unordered_set<std::string>();
+    symbol.classNames->insert(className);
+    set.insert(symbol);
+  } else {
+    iter->classNames->insert(className);
+  }
+}
+
+// Heap allocations made while filling symbolsForFile with every header
+// declaration, both ways. Each insertion starts from the names as the visitor
+// gets them from clang, a std::string for the legacy storage and a StringRef
+// to intern for the current one.
+void reportAllocations(const SyntheticTU &tu, uint64_t insertions) {
+  std::vector<std::vector<std::pair<std::pair<SymbolType, std::string>, std::string>>> declarations;
+  std::vector<std::string> headerNames;
+  for (size_t i = 0; i < tu.headers.size(); i++) {
+    headerNames.push_back(tu.symbols.names.name(tu.headers[i]).str());
+    declarations.emplace_back();
+    for (auto &declaration : tu.headerSymbols[i]) {
+      std::string className = declaration.second == InvalidName ? std::string()
+                                                                : tu.symbols.names.name(declaration.second).str();
+      declarations.back().push_back(std::make_pair(
+        std::make_pair(declaration.first.type, tu.symbols.names.name(declaration.first.name).str()), className));
+    }
+  }
+
+  uint64_t legacyAllocations;
+  {
+    uint64_t before = threadAllocationCount();
+    std::unordered_map<std::string, LegacySymbolSet> symbolsForFile;
+    for (size_t i = 0; i < headerNames.size(); i++) {
+      for (auto &declaration : declarations[i]) {
+        std::string name = declaration.first.second;
+        std::string className = declaration.second;
+        LegacySymbol symbol;
+        symbol.type = declaration.first.first;
+        symbol.value = name;
+        insertLegacySymbol(symbolsForFile[headerNames[i]], symbol, className);
+      }
+    }
+    legacyAllocations = threadAllocationCount() - before;
+    for (auto &file : symbolsForFile) {
+      for (const LegacySymbol &symbol : file.second) {
+        delete symbol.classNames;
+      }
+    }
+  }
+
+  uint64_t internedAllocations;
+  {
+    uint64_t before = threadAllocationCount();
+    TUSymbols symbols;
+    for (size_t i = 0; i < headerNames.size(); i++) {
+      SymbolSet &set = symbols.symbolsForFile[symbols.names.intern(headerNames[i])];
+      for (auto &declaration : declarations[i]) {
+        Symbol symbol = {declaration.first.first, symbols.names.intern(declaration.first.second)};
+        NameID className = declaration.second.empty() ? InvalidName : symbols.names.intern(declaration.second);
+        insertSymbol(set, symbol, className);
+      }
+    }
+    internedAllocations = threadAllocationCount() - before;
+  }
+
+  outs() << "\nAllocations filling symbolsForFile (" << insertions << " declarations):\n";
+  outs() << format("  std::string symbols %12llu (%.2f per declaration)\n",
+                   static_cast<unsigned long long>(legacyAllocations), double(legacyAllocations) / insertions);
+  outs() << format("  interned symbols    %12llu (%.2f per declaration)\n",
+                   static_cast<unsigned long long>(internedAllocations), double(internedAllocations) / insertions);
+}
+
+} // end anonymous namespace
+
+// Keeps results alive so the optimizer can't drop the work being timed.
+static volatile uint64_t sink;
+
+int main(int argc, const char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "objc-unused-imports matching benchmarks\n");
+
+  std::mt19937 random(Seed);
+  SyntheticTU tu = makeSyntheticTU(random);
+  outs() << tu.headers.size() << " headers, " << tu.classes.size() << " classes, "
+         << tu.symbols.names.size() << " names\n\n";
+
+  // insertSymbol, into fresh per-header sets like the visitor fills them.
+  uint64_t insertions = 0;
+  for (auto &declarations : tu.headerSymbols) {
+    insertions += declarations.size();
+  }
+  double insertTime = timeBest([&]() {
+    llvm::DenseMap<NameID, SymbolSet> symbolsForFile;
+    for (size_t i = 0; i < tu.headers.size(); i++) {
+      SymbolSet &set = symbolsForFile[tu.headers[i]];
+      for (auto &declaration : tu.headerSymbols[i]) {
+        insertSymbol(set, declaration.first, declaration.second);
+      }
+    }
+    sink = symbolsForFile.size();
+  });
+  report("insertSymbol", insertTime, insertions);
+
+  for (size_t i = 0; i < tu.headers.size(); i++) {
+    SymbolSet &set = tu.symbols.symbolsForFile[tu.headers[i]];
+    for (auto &declaration : tu.headerSymbols[i]) {
+      insertSymbol(set, declaration.first, declaration.second);
+    }
+  }
+
+  // isSameOrSubClass on random pairs, mostly unrelated classes like most
+  // receiver checks.
+  ClassHierarchy hierarchy(tu.symbols.superClass, tu.symbols.names.size());
+  std::vector<std::pair<NameID, NameID>> pairs;
+  const unsigned pairCount = 1 << 20;
+  for (unsigned i = 0; i < pairCount; i++) {
+    pairs.push_back(std::make_pair(tu.classes[random() % tu.classes.size()], tu.classes[random() % tu.classes.size()]));
+  }
+  double subclassTime = timeBest([&]() {
+    uint64_t matches = 0;
+    for (auto &pair : pairs) {
+      matches += hierarchy.isSameOrSubClass(pair.first, pair.second);
+    }
+    sink = matches;
+  });
+  report("isSameOrSubClass", subclassTime, pairs.size());
+
+  // matchWithClass and symbolUsed over every header declaration.
+  const SymbolSet &mainSymbols = tu.symbols.symbolsForFile[tu.symbols.mainFile];
+  UsageIndex usages(mainSymbols, tu.symbols.names.find("id"));
+  uint64_t classMatches = 0;
+  double matchTime = timeBest([&]() {
+    uint64_t matches = 0;
+    classMatches = 0;
+    for (NameID header : tu.headers) {
+      for (auto &entry : tu.symbols.symbolsForFile[header]) {
+        const UsageRule &rule = usageRules[static_cast<size_t>(entry.first.type)];
+        if (!rule.matchClass) {
+          continue;
+        }
+        classMatches++;
+        matches += matchWithClass(entry.second, usages.find(rule.usages[0], entry.first.name), usages, hierarchy);
+      }
+    }
+    sink = matches;
+  });
+  report("matchWithClass", matchTime, classMatches);
+
+  uint64_t symbolCount = 0;
+  double usedTime = timeBest([&]() {
+    uint64_t used = 0;
+    symbolCount = 0;
+    for (NameID header : tu.headers) {
+      for (auto &entry : tu.symbols.symbolsForFile[header]) {
+        symbolCount++;
+        used += symbolUsed(entry.first, entry.second, usages, hierarchy);
+      }
+    }
+    sink = used;
+  });
+  report("symbolUsed", usedTime, symbolCount);
+
+  double findTime = timeBest([&]() {
+    sink = findUnusedImports(tu.symbols).size();
+  });
+  report("findUnusedImports", findTime, tu.headers.size());
+
+  size_t symbolBytes = 0;
+  for (auto &fileSymbols : tu.symbols.symbolsForFile) {
+    symbolBytes += symbolSetMemory(fileSymbols.second);
+  }
+  symbolBytes += tu.symbols.symbolsForFile.getMemorySize();
+  outs() << "\nMemory:\n";
+  reportMemory("symbolsForFile", symbolBytes);
+  reportMemory("names", tu.symbols.names.getMemorySize());
+  reportMemory("ClassHierarchy", hierarchy.getMemorySize());
+
+  reportAllocations(tu, insertions);
+  return 0;
+}
@@ -0,0 +1,103 @@
+#include "ImportFixes.h"
+#include "gtest/gtest.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+class ImportFixesTest : public ::testing::Test {
+protected:
+  SmallString<128> directory;
+
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createUniqueDirectory("import-fixes-test", directory));
+  }
+
+  void TearDown() override {
+    sys::fs::remove_directories(directory);
+  }
+
+  std::string pathFor(StringRef name) {
+    SmallString<128> path(directory);
+    sys::path::append(path, name);
+    return path.str().str();
+  }
+
+  // Removes the unused imports on the given lines of a file with `contents`,
+  // returns what the file holds afterwards.
+  std::string fix(StringRef contents, const std::vector<unsigned> &lines, ImportFixes &fixes) {
+    std::string path = pathFor("Main.m");
+    {
+      std::error_code error;
+      raw_fd_ostream stream(path, error, sys::fs::F_None);
+      EXPECT_FALSE(error);
+      stream << contents;
+    }
+    std::vector<UnusedImport> unusedImports;
+    for (unsigned line : lines) {
+      UnusedImport unusedImport;
+      unusedImport.name = "Unused.h";
+      unusedImport.line = line;
+      unusedImports.push_back(unusedImport);
+    }
+    fixes.add(path, unusedImports);
+    std::string errors;
+    raw_string_ostream errorStream(errors);
+    EXPECT_TRUE(fixes.apply(errorStream));
+    EXPECT_EQ("", errorStream.str());
+
+    ErrorOr<std::unique_ptr<MemoryBuffer>> fixed = MemoryBuffer::getFile(path);
+    EXPECT_TRUE(bool(fixed));
+    return fixed ? (*fixed)->getBuffer().str() : std::string();
+  }
+};
+
+TEST_F(ImportFixesTest, RemovesTheLinesOfUnusedImports) {
+  ImportFixes fixes;
+  EXPECT_EQ("#import \"Used.h\"\n\nint x;\n",
+            fix("#import \"Used.h\"\n#import <Unused/Unused.h>\n  #  include \"Other.h\"  \n@import Kit.Sub;\n\nint x;\n",
+                {2, 3, 4}, fixes));
+  EXPECT_EQ(3u, fixes.getFixCount());
+  EXPECT_EQ(0u, fixes.getSkippedCount());
+}
+
+TEST_F(ImportFixesTest, LeavesLinesHoldingMoreThanTheDirective) {
+  const char *contents = "@import A; @import B;\n"
+                         "#import <A.h> // needed for B\n"
+                         "#import \"A.h\" int x;\n"
+                         "#import <A.h> \\\n"
+                         "\n"
+                         "int y;\n";
+  ImportFixes fixes;
+  EXPECT_EQ(contents, fix(contents, {1, 2, 3, 4, 6}, fixes));
+  EXPECT_EQ(0u, fixes.getFixCount());
+  EXPECT_EQ(5u, fixes.getSkippedCount());
+}
+
+TEST_F(ImportFixesTest, ImportsReplacedByForwardDeclarationsAreKept) {
+  std::string path = pathFor("Header.h");
+  {
+    std::error_code error;
+    raw_fd_ostream stream(path, error, sys::fs::F_None);
+    ASSERT_FALSE(error);
+    stream << "#import \"Base.h\"\n";
+  }
+  UnusedImport unusedImport;
+  unusedImport.name = "Base.h";
+  unusedImport.line = 1;
+  unusedImport.forwardDeclarations.push_back("@class Base;");
+  ImportFixes fixes;
+  fixes.add(path, {unusedImport});
+  EXPECT_EQ(0u, fixes.getFixCount());
+}
+
+} // end anonymous namespace
@@ -0,0 +1,84 @@
+#include "ImportIndex.h"
+#include "gtest/gtest.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+class ImportIndexTest : public ::testing::Test {
+protected:
+  SmallString<128> directory;
+
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createUniqueDirectory("import-index-test", directory));
+  }
+
+  void TearDown() override {
+    sys::fs::remove_directories(directory);
+  }
+
+  std::string pathFor(StringRef name) {
+    SmallString<128> path(directory);
+    sys::path::append(path, name);
+    return path.str().str();
+  }
+};
+
+// An umbrella header only imports other headers, so the TU has a line for it
+// but no symbols.
+TEST_F(ImportIndexTest, ImportsThatDeclareNothingAreIndexed) {
+  TUSymbols symbols;
+  symbols.mainFile = symbols.names.intern("Main.m");
+  NameID umbrella = symbols.names.intern("Sources/Kit/Kit.h");
+  NameID header = symbols.names.intern("Sources/Kit/Widget.h");
+  NameID module = symbols.names.intern("Foundation.NSString");
+  symbols.lineNumbers[umbrella] = 1;
+  symbols.lineNumbers[header] = 2;
+  symbols.lineNumbers[module] = 3;
+  symbols.modulesImported.insert(module);
+  insertSymbol(symbols.symbolsForFile[header],
+               Symbol{SymbolType::ClassDeclaration, symbols.names.intern("Widget")});
+
+  UnusedImport unusedImport;
+  unusedImport.name = "Sources/Kit/Widget.h";
+  unusedImport.line = 2;
+  ImportIndexWriter writer(pathFor("index"));
+  writer.add("Main.m", 0, symbols, unusedImport);
+  ASSERT_FALSE(writer.save());
+
+  std::string error;
+  std::unique_ptr<ImportIndex> index = ImportIndex::open(pathFor("index"), error);
+  ASSERT_TRUE(index) << error;
+  EXPECT_EQ(3u, index->getImportCount());
+
+  std::vector<size_t> positions = index->find("Kit.h");
+  ASSERT_EQ(1u, positions.size());
+  EXPECT_EQ("Sources/Kit/Kit.h", index->importAt(positions[0]));
+  std::vector<ImportReference> references = index->referencesAt(positions[0]);
+  ASSERT_EQ(1u, references.size());
+  EXPECT_EQ("Main.m", references[0].file);
+  EXPECT_EQ(1u, references[0].line);
+  EXPECT_TRUE(references[0].used);
+  EXPECT_FALSE(references[0].failed);
+
+  positions = index->find("Widget.h");
+  ASSERT_EQ(1u, positions.size());
+  unsigned importers = 0;
+  unsigned users = 0;
+  index->countsAt(positions[0], importers, users);
+  EXPECT_EQ(1u, importers);
+  EXPECT_EQ(0u, users);
+
+  // Modules are indexed under their top-level name.
+  EXPECT_EQ(1u, index->find("Foundation").size());
+  EXPECT_TRUE(index->find("Foundation.NSString").empty());
+}
+
+} // end anonymous namespace
@@ -0,0 +1,220 @@
+#include "Matching.h"
+#include "ModuleIndex.h"
+#include "SymbolTable.h"
+#include "gtest/gtest.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> unusedNames(const TUSymbols &tu) {
+  std::vector<std::string> names;
+  for (const UnusedImport &unusedImport : findUnusedImports(tu)) {
+    names.push_back(unusedImport.name + ":" + std::to_string(unusedImport.line));
+  }
+  return names;
+}
+
+// A TU whose main file imports Used.h and Unused.h.
+struct TwoHeaders {
+  TUSymbols tu;
+  SymbolSet *used;
+  SymbolSet *unused;
+  SymbolSet *main;
+
+  TwoHeaders() {
+    tu.mainFile = tu.names.intern("Main.m");
+    NameID usedHeader = tu.names.intern("Used.h");
+    NameID unusedHeader = tu.names.intern("Unused.h");
+    tu.lineNumbers[usedHeader] = 1;
+    tu.lineNumbers[unusedHeader] = 2;
+    used = &tu.symbolsForFile[usedHeader];
+    unused = &tu.symbolsForFile[unusedHeader];
+    main = &tu.symbolsForFile[tu.mainFile];
+  }
+
+  Symbol symbol(SymbolType type, const char *name) {
+    return Symbol{type, tu.names.intern(name)};
+  }
+};
+
+TEST(MatchingTest, ReportsHeadersWhoseSymbolsAreNotUsed) {
+  TwoHeaders headers;
+  insertSymbol(*headers.used, headers.symbol(SymbolType::ClassDeclaration, "Used"));
+  insertSymbol(*headers.unused, headers.symbol(SymbolType::ClassDeclaration, "Unused"));
+  insertSymbol(*headers.main, headers.symbol(SymbolType::Class, "Used"));
+
+  EXPECT_EQ(std::vector<std::string>({"Unused.h:2"}), unusedNames(headers.tu));
+}
+
+TEST(MatchingTest, MethodsMatchSubclassAndIdReceivers) {
+  TwoHeaders headers;
+  NameID base = headers.tu.names.intern("Base");
+  NameID derived = headers.tu.names.intern("Derived");
+  NameID unrelated = headers.tu.names.intern("Unrelated");
+  headers.tu.superClass[derived] = base;
+  insertSymbol(*headers.used, headers.symbol(SymbolType::MethodDeclaration, "run"), base);
+  insertSymbol(*headers.unused, headers.symbol(SymbolType::MethodDeclaration, "stop"), base);
+
+  insertSymbol(*headers.main, headers.symbol(SymbolType::Method, "run"), derived);
+  insertSymbol(*headers.main, headers.symbol(SymbolType::Method, "stop"), unrelated);
+  EXPECT_EQ(std::vector<std::string>({"Unused.h:2"}), unusedNames(headers.tu));
+
+  insertSymbol(*headers.main, headers.symbol(SymbolType::Method, "stop"), headers.tu.names.intern("id"));
+  EXPECT_TRUE(unusedNames(headers.tu).empty());
+}
+
+TEST(MatchingTest, SameNameInAnotherHeaderIsNotAUse) {
+  TwoHeaders headers;
+  insertSymbol(*headers.used, headers.symbol(SymbolType::MethodDeclaration, "count"), headers.tu.names.intern("List"));
+  insertSymbol(*headers.unused, headers.symbol(SymbolType::MethodDeclaration, "count"), headers.tu.names.intern("Set"));
+  insertSymbol(*headers.main, headers.symbol(SymbolType::Method, "count"), headers.tu.names.intern("List"));
+
+  EXPECT_EQ(std::vector<std::string>({"Unused.h:2"}), unusedNames(headers.tu));
+}
+
+TEST(MatchingTest, ImportsUsedByDeclarationAreNotReported) {
+  TwoHeaders headers;
+  insertSymbol(*headers.used, headers.symbol(SymbolType::TypedefDeclaration, "Handler"));
+  insertSymbol(*headers.unused, headers.symbol(SymbolType::TypedefDeclaration, "Handler"));
+  headers.tu.usedImports.insert(headers.tu.names.find("Used.h"));
+
+  EXPECT_EQ(std::vector<std::string>({"Unused.h:2"}), unusedNames(headers.tu));
+}
+
+// Both headers declare log(), the main file calls the one Used.h declares.
+// Only the header of the referenced declaration is used, whatever the other
+// one declares under the same name.
+TEST(MatchingTest, SameFunctionNameInTwoHeadersOnlyUsesTheReferencedOne) {
+  TwoHeaders headers;
+  insertSymbol(*headers.used, headers.symbol(SymbolType::FunctionDeclaration, "log"));
+  insertSymbol(*headers.unused, headers.symbol(SymbolType::FunctionDeclaration, "log"));
+  insertSymbol(*headers.unused, headers.symbol(SymbolType::VariableDeclaration, "level"));
+  insertSymbol(*headers.unused, headers.symbol(SymbolType::EnumConstantDeclaration, "LevelDebug"));
+  EXPECT_EQ(std::vector<std::string>({"Used.h:1", "Unused.h:2"}), unusedNames(headers.tu));
+
+  headers.tu.usedImports.insert(headers.tu.names.find("Used.h"));
+  EXPECT_EQ(std::vector<std::string>({"Unused.h:2"}), unusedNames(headers.tu));
+}
+
+// A module another TU collected, whose protocol this TU never names.
+TEST(MatchingTest, IndexedProtocolMethodMatchesIdReceiver) {
+  std::shared_ptr<ModuleExports> exports = std::make_shared<ModuleExports>();
+  insertSymbol(exports->symbols, Symbol{SymbolType::MethodDeclaration, exports->names.intern("notify")},
+               exports->names.intern("Observer"));
+
+  TUSymbols tu;
+  tu.mainFile = tu.names.intern("Main.m");
+  NameID module = tu.names.intern("Kit");
+  tu.modulesImported.insert(module);
+  tu.lineNumbers[module] = 1;
+  tu.indexedModules.push_back(std::make_pair(module, exports));
+  insertSymbol(tu.symbolsForFile[tu.mainFile], Symbol{SymbolType::Method, tu.names.intern("notify")},
+               tu.names.intern("id"));
+
+  EXPECT_TRUE(unusedNames(tu).empty());
+}
+
+// Builds the same TU for the same seed: a partial class hierarchy, a few main
+// file usages and modules collected by another TU, in names of their own.
+void buildRandomTU(unsigned seed, TUSymbols &tu) {
+  std::mt19937 random(seed);
+  auto pick = [&random](const char *prefix, unsigned count) {
+    return prefix + std::to_string(random() % count);
+  };
+  tu.mainFile = tu.names.intern("Main.m");
+
+  std::vector<NameID> classes;
+  for (unsigned i = 0; i < 12; i++) {
+    if (random() % 2) {
+      NameID name = tu.names.intern("C" + std::to_string(i));
+      if (!classes.empty() && random() % 3) {
+        tu.superClass[name] = classes[random() % classes.size()];
+      }
+      classes.push_back(name);
+    }
+  }
+
+  SymbolSet &main = tu.symbolsForFile[tu.mainFile];
+  unsigned usageCount = random() % 6;
+  for (unsigned i = 0; i < usageCount; i++) {
+    switch (random() % 3) {
+      case 0: {
+        NameID receiver = classes.empty() || random() % 3 == 0 ? tu.names.intern("id") : classes[random() % classes.size()];
+        insertSymbol(main, Symbol{SymbolType::Method, tu.names.intern(pick("s", 10))}, receiver);
+        break;
+      }
+      case 1:
+        // A declaration the main file references, attributed to its module.
+        tu.usedImports.insert(tu.names.intern(pick("M", 4)));
+        break;
+      default:
+        insertSymbol(main, Symbol{SymbolType::Class, tu.names.intern(pick("C", 12))});
+        break;
+    }
+  }
+
+  for (unsigned i = 0; i < 3; i++) {
+    std::shared_ptr<ModuleExports> exports = std::make_shared<ModuleExports>();
+    NameTable &names = exports->names;
+    unsigned symbolCount = 1 + random() % 6;
+    for (unsigned j = 0; j < symbolCount; j++) {
+      switch (random() % 3) {
+        case 0: {
+          std::string className = random() % 2 ? pick("C", 12) : pick("P", 4);
+          insertSymbol(exports->symbols, Symbol{SymbolType::MethodDeclaration, names.intern(pick("s", 10))},
+                       names.intern(className));
+          break;
+        }
+        case 1:
+          insertSymbol(exports->symbols, Symbol{SymbolType::FunctionDeclaration, names.intern(pick("f", 10))});
+          break;
+        default:
+          insertSymbol(exports->symbols, Symbol{SymbolType::ClassDeclaration, names.intern(pick("C", 12))});
+          break;
+      }
+    }
+    NameID module = tu.names.intern("M" + std::to_string(i));
+    tu.modulesImported.insert(module);
+    tu.lineNumbers[module] = i + 1;
+    tu.indexedModules.push_back(std::make_pair(module, exports));
+  }
+}
+
+// Matching an indexed module has to give the same result as matching its
+// symbols copied into the TU, whichever names the TU happens to have interned.
+TEST(MatchingTest, IndexedModulesMatchLikeTheirSymbolsInTheTU) {
+  for (unsigned seed = 0; seed < 2000; seed++) {
+    TUSymbols indexed;
+    buildRandomTU(seed, indexed);
+    TUSymbols materialized;
+    buildRandomTU(seed, materialized);
+    materializeIndexedModules(materialized);
+
+    EXPECT_EQ(unusedNames(materialized), unusedNames(indexed)) << "seed " << seed;
+  }
+}
+
+TEST(ClassHierarchyTest, SubclassChecksFollowTheForest) {
+  TUSymbols tu;
+  NameID root = tu.names.intern("Root");
+  NameID child = tu.names.intern("Child");
+  NameID grandChild = tu.names.intern("GrandChild");
+  NameID other = tu.names.intern("Other");
+  NameID unknown = tu.names.intern("Unknown");
+  tu.superClass[child] = root;
+  tu.superClass[grandChild] = child;
+  tu.superClass[other] = tu.names.intern("OtherRoot");
+  ClassHierarchy hierarchy(tu.superClass, tu.names.size());
+
+  EXPECT_TRUE(hierarchy.isSameOrSubClass(root, grandChild));
+  EXPECT_TRUE(hierarchy.isSameOrSubClass(child, child));
+  EXPECT_FALSE(hierarchy.isSameOrSubClass(grandChild, root));
+  EXPECT_FALSE(hierarchy.isSameOrSubClass(root, other));
+  EXPECT_FALSE(hierarchy.isSameOrSubClass(root, unknown));
+  EXPECT_FALSE(hierarchy.isSameOrSubClass(InvalidName, root));
+}
+
+} // end anonymous namespace
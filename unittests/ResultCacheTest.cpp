@@ -0,0 +1,152 @@
+#include "ResultCache.h"
+#include "gtest/gtest.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// A directory holding the cache and the files the stored TUs read.
+class ResultCacheTest : public ::testing::Test {
+protected:
+  SmallString<128> directory;
+
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createUniqueDirectory("result-cache-test", directory));
+  }
+
+  void TearDown() override {
+    sys::fs::remove_directories(directory);
+  }
+
+  std::string pathFor(StringRef name) {
+    SmallString<128> path(directory);
+    sys::path::append(path, name);
+    return path.str().str();
+  }
+
+  void writeFile(StringRef name, StringRef contents, sys::TimePoint<> modificationTime) {
+    int fd;
+    ASSERT_FALSE(sys::fs::openFileForWrite(pathFor(name), fd));
+    raw_fd_ostream stream(fd, /*shouldClose=*/true);
+    stream << contents;
+    stream.flush();
+    ASSERT_FALSE(sys::fs::setLastModificationAndAccessTime(fd, modificationTime));
+  }
+
+  static void store(ResultCache &cache, StringRef key, ArrayRef<FileStamp> dependencies) {
+    UnusedImport unusedImport;
+    unusedImport.name = "Unused.h";
+    unusedImport.line = 3;
+    unusedImport.symbols = 2;
+    cache.store(key, 1, dependencies, unusedImport);
+  }
+
+  static bool hits(ResultCache &cache, StringRef key) {
+    int status;
+    std::vector<UnusedImport> unusedImports;
+    return cache.lookup(key, status, unusedImports);
+  }
+};
+
+const sys::TimePoint<> Written = sys::toTimePoint(1500000000);
+
+TEST_F(ResultCacheTest, StoredResultsAreReplayed) {
+  writeFile("Header.h", "@interface A\n@end\n", Written);
+  std::string key = ResultCache::makeKey("clang -c Main.m", "#import \"Header.h\"\n");
+  {
+    ResultCache cache(pathFor("cache"));
+    EXPECT_FALSE(hits(cache, key));
+    store(cache, key, ResultCache::stampFile(pathFor("Header.h")));
+    ASSERT_FALSE(cache.save());
+  }
+
+  ResultCache cache(pathFor("cache"));
+  int status = 0;
+  std::vector<UnusedImport> unusedImports;
+  ASSERT_TRUE(cache.lookup(key, status, unusedImports));
+  EXPECT_EQ(1, status);
+  ASSERT_EQ(1u, unusedImports.size());
+  EXPECT_EQ("Unused.h", unusedImports[0].name);
+  EXPECT_EQ(3u, unusedImports[0].line);
+  EXPECT_EQ(2u, unusedImports[0].symbols);
+  EXPECT_FALSE(hits(cache, ResultCache::makeKey("clang -c Main.m", "")));
+}
+
+TEST_F(ResultCacheTest, RewriteWithinASecondMisses) {
+  writeFile("Header.h", "@interface A\n@end\n", Written);
+  std::string key = ResultCache::makeKey("clang -c Main.m", "");
+  {
+    ResultCache cache(pathFor("cache"));
+    store(cache, key, ResultCache::stampFile(pathFor("Header.h")));
+    ASSERT_FALSE(cache.save());
+  }
+
+  writeFile("Header.h", "@interface B\n@end\n", Written + std::chrono::milliseconds(1));
+  ResultCache cache(pathFor("cache"));
+  EXPECT_FALSE(hits(cache, key));
+}
+
+TEST_F(ResultCacheTest, FileChangedWhileReadMisses) {
+  writeFile("Header.h", "@interface A\n@end\n", Written);
+  std::string key = ResultCache::makeKey("clang -c Main.m", "");
+  {
+    ResultCache cache(pathFor("cache"));
+    // What the compiler read was one byte shorter than the file is now.
+    store(cache, key, ResultCache::stampFile(pathFor("Header.h"), 17, sys::toTimeT(Written)));
+    ASSERT_FALSE(cache.save());
+  }
+
+  ResultCache cache(pathFor("cache"));
+  EXPECT_FALSE(hits(cache, key));
+}
+
+TEST_F(ResultCacheTest, SaveDropsEntriesOfChangedFiles) {
+  writeFile("Header.h", "@interface A\n@end\n", Written);
+  std::string staleKey = ResultCache::makeKey("clang -c Old.m", "");
+  {
+    ResultCache cache(pathFor("cache"));
+    store(cache, staleKey, ResultCache::stampFile(pathFor("Header.h")));
+    ASSERT_FALSE(cache.save());
+  }
+
+  ASSERT_FALSE(sys::fs::remove(pathFor("Header.h")));
+  {
+    ResultCache cache(pathFor("cache"));
+    store(cache, ResultCache::makeKey("clang -c New.m", ""), ArrayRef<FileStamp>());
+    ASSERT_FALSE(cache.save());
+  }
+
+  // The header is back as it was, but its entry is gone.
+  writeFile("Header.h", "@interface A\n@end\n", Written);
+  ResultCache cache(pathFor("cache"));
+  EXPECT_FALSE(hits(cache, staleKey));
+  EXPECT_TRUE(hits(cache, ResultCache::makeKey("clang -c New.m", "")));
+}
+
+TEST_F(ResultCacheTest, ConcurrentRunsKeepEachOthersResults) {
+  std::string firstKey = ResultCache::makeKey("clang -c First.m", "");
+  std::string secondKey = ResultCache::makeKey("clang -c Second.m", "");
+  {
+    ResultCache first(pathFor("cache"));
+    ResultCache second(pathFor("cache"));
+    store(first, firstKey, ArrayRef<FileStamp>());
+    store(second, secondKey, ArrayRef<FileStamp>());
+    ASSERT_FALSE(first.save());
+    ASSERT_FALSE(second.save());
+  }
+
+  ResultCache cache(pathFor("cache"));
+  EXPECT_TRUE(hits(cache, firstKey));
+  EXPECT_TRUE(hits(cache, secondKey));
+}
+
+} // end anonymous namespace
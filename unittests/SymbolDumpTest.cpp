@@ -0,0 +1,157 @@
+#include "SymbolDump.h"
+#include "gtest/gtest.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+using namespace llvm;
+
+namespace {
+
+class SymbolDumpTest : public ::testing::Test {
+protected:
+  SmallString<128> directory;
+
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createUniqueDirectory("symbol-dump-test", directory));
+  }
+
+  void TearDown() override {
+    sys::fs::remove_directories(directory);
+  }
+
+  std::string pathFor(StringRef name) {
+    SmallString<128> path(directory);
+    sys::path::append(path, name);
+    return path.str().str();
+  }
+
+  // A TU with an entry in every table.
+  static void fill(TUSymbols &symbols) {
+    symbols.mainFile = symbols.names.intern("Main.m");
+    NameID header = symbols.names.intern("Header.h");
+    NameID module = symbols.names.intern("Kit");
+    NameID base = symbols.names.intern("Base");
+    NameID derived = symbols.names.intern("Derived");
+    symbols.lineNumbers[header] = 1;
+    symbols.lineNumbers[module] = 2;
+    symbols.modulesImported.insert(module);
+    symbols.usedImports.insert(header);
+    symbols.superClass[derived] = base;
+    insertSymbol(symbols.symbolsForFile[header], Symbol{SymbolType::MethodDeclaration, symbols.names.intern("run")},
+                 base);
+    insertSymbol(symbols.symbolsForFile[symbols.mainFile], Symbol{SymbolType::Method, symbols.names.intern("run")},
+                 derived);
+  }
+
+  void writeDump(StringRef name) {
+    TUSymbols symbols;
+    fill(symbols);
+    std::error_code error;
+    SymbolDumpWriter writer(pathFor(name), error);
+    ASSERT_FALSE(error);
+    writer.add("Main.m", 1, symbols);
+    ASSERT_FALSE(writer.close());
+  }
+};
+
+// Every ID a TU read from a dump refers to one of its names.
+void expectValidIDs(const TUSymbols &symbols) {
+  size_t nameCount = symbols.names.size();
+  EXPECT_TRUE(symbols.mainFile == InvalidName || symbols.mainFile < nameCount);
+  for (auto &fileSymbols : symbols.symbolsForFile) {
+    EXPECT_LT(fileSymbols.first, nameCount);
+    for (auto &entry : fileSymbols.second) {
+      EXPECT_LT(entry.first.name, nameCount);
+      for (NameID className : entry.second) {
+        EXPECT_LT(className, nameCount);
+      }
+    }
+  }
+  for (auto &line : symbols.lineNumbers) {
+    EXPECT_LT(line.first, nameCount);
+  }
+  for (NameID module : symbols.modulesImported) {
+    EXPECT_LT(module, nameCount);
+  }
+  for (NameID import : symbols.usedImports) {
+    EXPECT_LT(import, nameCount);
+  }
+  for (auto &link : symbols.superClass) {
+    EXPECT_LT(link.first, nameCount);
+    EXPECT_LT(link.second, nameCount);
+  }
+}
+
+TEST_F(SymbolDumpTest, TUsReadBackAsWritten) {
+  writeDump("dump");
+  std::string error;
+  std::unique_ptr<SymbolDump> dump = SymbolDump::open(pathFor("dump"), error);
+  ASSERT_TRUE(dump) << error;
+  ASSERT_EQ(1u, dump->size());
+
+  DumpedTU tu;
+  ASSERT_TRUE(dump->read(0, tu));
+  TUSymbols expected;
+  fill(expected);
+  const TUSymbols &symbols = tu.symbols;
+  EXPECT_EQ("Main.m", tu.file);
+  EXPECT_EQ(1, tu.status);
+  ASSERT_EQ(expected.names.size(), symbols.names.size());
+  for (NameID name = 0; name < expected.names.size(); name++) {
+    EXPECT_EQ(expected.names.name(name), symbols.names.name(name));
+  }
+  EXPECT_EQ(expected.mainFile, symbols.mainFile);
+  EXPECT_EQ(expected.lineNumbers, symbols.lineNumbers);
+  EXPECT_EQ(expected.modulesImported, symbols.modulesImported);
+  EXPECT_EQ(expected.usedImports, symbols.usedImports);
+  EXPECT_EQ(expected.superClass, symbols.superClass);
+  ASSERT_EQ(expected.symbolsForFile.size(), symbols.symbolsForFile.size());
+  for (auto &fileSymbols : expected.symbolsForFile) {
+    auto iter = symbols.symbolsForFile.find(fileSymbols.first);
+    ASSERT_NE(symbols.symbolsForFile.end(), iter);
+    EXPECT_EQ(fileSymbols.second, iter->second);
+  }
+}
+
+// Replacing any 32-bit word of the TU with an ID past the name table, the empty
+// and tombstone keys included, either rejects the TU or leaves it valid.
+TEST_F(SymbolDumpTest, OutOfRangeIDsAreRejected) {
+  writeDump("dump");
+  ErrorOr<std::unique_ptr<MemoryBuffer>> original = MemoryBuffer::getFile(pathFor("dump"));
+  ASSERT_TRUE(bool(original));
+  std::string data = (*original)->getBuffer().str();
+  // Magic, version and the block's size come first.
+  const size_t blockStart = 16;
+
+  unsigned rejected = 0;
+  for (uint32_t value : {uint32_t(5), UINT32_MAX - 1, UINT32_MAX}) {
+    for (size_t offset = blockStart; offset + 4 <= data.size(); offset++) {
+      std::string corrupt = data;
+      support::endian::write32le(&corrupt[offset], value);
+      {
+        std::error_code error;
+        raw_fd_ostream stream(pathFor("corrupt"), error, sys::fs::F_None);
+        ASSERT_FALSE(error);
+        stream << corrupt;
+      }
+      std::string error;
+      std::unique_ptr<SymbolDump> dump = SymbolDump::open(pathFor("corrupt"), error);
+      ASSERT_TRUE(dump) << error;
+      DumpedTU tu;
+      if (dump->read(0, tu)) {
+        expectValidIDs(tu.symbols);
+      } else {
+        rejected++;
+      }
+    }
+  }
+  EXPECT_GT(rejected, 0u);
+}
+
+} // end anonymous namespace